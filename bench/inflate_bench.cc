@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include "inflate.h"
+
+using namespace zz;
+using namespace std;
+namespace bio = boost::iostreams;
+
+// Times the inflater of this build against the Boost.Iostreams chain zip2zip used before it, the way zip2zip
+// decodes entries: many small ones in one go, and a few large ones through a fixed buffer.
+// Usage: inflate_bench [small entries] [large entries] [MiB per large entry]
+
+static string make_text(mt19937_64 &random, size_t length)
+{
+    static const char *const words[] = { "zip", "entry", "header", "central", "directory", "local", "file",
+                                         "data", "descriptor", "deflate", "stored", "0", "1", "2", "2026" };
+    string s;
+    s.reserve(length + 16);
+    while (s.size() < length) {
+        s += words[random() % size(words)];
+        s += random() % 8 ? ' ' : '\n';
+    }
+    s.resize(length);
+    return s;
+}
+
+static string deflate(const string &s)
+{
+    bio::zlib_params params;
+    params.noheader = true;
+    ostringstream out;
+    bio::filtering_ostream stream;
+    stream.push(bio::zlib_compressor(params));
+    stream.push(out);
+    stream.write(s.data(), static_cast<streamsize>(s.size()));
+    stream.reset();
+    return move(out).str();
+}
+
+struct entry
+{
+    string data;
+    string deflated;
+};
+
+// decodes every entry with the given function, returning the best of three runs in seconds
+template <typename function_type>
+static double time(const vector<entry> &entries, function_type decode)
+{
+    auto best = numeric_limits<double>::max();
+    for (auto run = 0; run < 3; run++) {
+        const auto start = chrono::steady_clock::now();
+        for (const auto &e : entries)
+            if (!decode(e))
+                throw runtime_error("decoded data differs");
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+try
+{
+    const auto small = argc > 1 ? stoul(argv[1]) : 2000ul;
+    const auto large = argc > 2 ? stoul(argv[2]) : 3ul;
+    const auto mib   = argc > 3 ? stoul(argv[3]) : 32ul;
+    constexpr size_t buffer_size = 1 << 20;
+
+    mt19937_64 random(20261017);
+    vector<entry> smalls, larges;
+    for (size_t i = 0; i < small; i++) {
+        auto data = make_text(random, 1024 + random() % (64 << 10));
+        smalls.push_back({ data, deflate(data) });
+    }
+    for (size_t i = 0; i < large; i++) {
+        auto data = make_text(random, mib << 20);
+        larges.push_back({ data, deflate(data) });
+    }
+
+    vector<char> buf(buffer_size);
+    const auto whole = [&buf](const entry &e) {
+        return inflater::get().inflate(e.deflated, data(buf), size(e.data)) && memcmp(data(buf), data(e.data), size(e.data)) == 0;
+    };
+    const auto streamed = [&buf](const entry &e) {
+        auto &inflater = inflater::get();
+        inflater.reset(e.deflated);
+        size_t done = 0;
+        for (size_t n; inflater.read(data(buf), size(buf), n); done += n) {
+            if (n == 0)
+                return done == size(e.data);
+            if (n > size(e.data) - done || memcmp(data(buf), data(e.data) + done, n) != 0)
+                return false;
+        }
+        return false;
+    };
+    const auto boost = [&buf](const entry &e) {
+        bio::zlib_params params;
+        params.noheader = true;
+        bio::filtering_istream stream;
+        stream.push(bio::zlib_decompressor(params, buffer_size));
+        stream.push(bio::array_source(e.deflated.data(), e.deflated.size()));
+        size_t done = 0;
+        while (const auto n = static_cast<size_t>(stream.read(data(buf), ssize(buf)).gcount())) {
+            if (n > size(e.data) - done || memcmp(data(buf), data(e.data) + done, n) != 0)
+                return false;
+            done += n;
+        }
+        return done == size(e.data);
+    };
+
+    const auto report = [](const char *name, const vector<entry> &entries, double seconds) {
+        size_t bytes = 0;
+        for (const auto &e : entries)
+            bytes += size(e.data);
+        cout << "  " << left << setw(28) << name << right << fixed << setprecision(3) << setw(8) << seconds << " s "
+             << setprecision(0) << setw(6) << bytes / seconds / (1 << 20) << " MiB/s" << endl;
+    };
+    cout << small << " small entries:" << endl;
+    report("inflater, whole", smalls, time(smalls, whole));
+    report("Boost.Iostreams", smalls, time(smalls, boost));
+    cout << large << " entries of " << mib << " MiB:" << endl;
+    report("inflater, streamed", larges, time(larges, streamed));
+    report("Boost.Iostreams", larges, time(larges, boost));
+    return 0;
+}
+catch (const exception &ex)
+{
+    cerr << "Error: " << ex.what() << endl;
+    return 1;
+}
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#ifndef _WIN32
+#include <cerrno>
+#include <iconv.h>
+#endif
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+#include <boost/locale/encoding.hpp>
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+#include "strnatcmp.h"
+
+#include "charset.h"
+
+using namespace zz::charset;
+using namespace std;
+
+static const string utf8_charsets[] = { "CP65001", "UTF-8", "UTF8" };
+
+#ifndef _WIN32
+static const auto invalid_iconv = reinterpret_cast<iconv_t>(-1);
+
+static string convert(iconv_t cd, const char *data, size_t size)
+{
+    iconv(cd, nullptr, nullptr, nullptr, nullptr);
+    string out(max<size_t>(size * 2, 16), '\0');
+    auto in = const_cast<char *>(data);
+    auto in_left = size;
+    size_t pos = 0;
+    // the input is drained first, then a stateful charset gets to return to its initial shift state,
+    // which also leaves the descriptor ready for the next string
+    for (auto flush = false; ; ) {
+        auto p = &out[pos];
+        auto out_left = out.size() - pos;
+        const auto result = flush
+            ? iconv(cd, nullptr, nullptr, &p, &out_left)
+            : iconv(cd, &in, &in_left, &p, &out_left);
+        pos = static_cast<size_t>(p - out.data());
+        if (result != static_cast<size_t>(-1)) {
+            if (flush)
+                break;
+            flush = in_left == 0;
+            continue;
+        }
+        if (errno == E2BIG)
+            out.resize(out.size() * 2);
+        else if (errno == EILSEQ && !flush)
+            in++, in_left--; // skip like boost::locale::conv::skip
+        else if (!flush)
+            flush = true; // an incomplete sequence at the end is dropped
+        else
+            break;
+    }
+    out.resize(pos);
+    return out;
+}
+#endif
+
+namespace
+{
+    struct converter
+    {
+        explicit converter(const string &charset)
+            : name(charset)
+            , utf8(any_of(begin(utf8_charsets), end(utf8_charsets),
+                          [&charset](const string &s) { return strnatcasecmp(s, charset) == 0; }))
+        {
+#ifndef _WIN32
+            if (!utf8) {
+                to_utf   = iconv_open("UTF-8", charset.c_str());
+                from_utf = iconv_open(charset.c_str(), "UTF-8");
+            }
+#endif
+            // names made of ASCII alone pass through untouched unless the charset remaps them
+            string ascii(0x7F, '\0');
+            for (size_t i = 0; i < ascii.size(); i++)
+                ascii[i] = static_cast<char>(1 + i);
+            const auto decoded = utf8 ? string_type(begin(ascii), end(ascii)) : decode(ascii);
+            ascii_compatible = decoded.size() == ascii.size() && equal(begin(ascii), end(ascii), begin(decoded));
+            // unless other characters are spelled in ASCII bytes too, as in the 7-bit ISO-2022 charsets
+            for (const auto sample : { "\xC3\xA9", "\xE3\x81\x82", "\xE4\xB8\x80" }) {
+                if (!ascii_compatible || utf8)
+                    break;
+                const auto encoded = encode(decode_utf8(sample));
+                ascii_compatible = encoded.empty() || !is_ascii(encoded.data(), encoded.size());
+            }
+        }
+        converter(const converter &) = delete;
+        converter & operator = (const converter &) = delete;
+        ~converter()
+        {
+#ifndef _WIN32
+            if (to_utf != invalid_iconv)
+                iconv_close(to_utf);
+            if (from_utf != invalid_iconv)
+                iconv_close(from_utf);
+#endif
+        }
+
+        string_type decode(const string &s) const
+        {
+#ifndef _WIN32
+            if (to_utf != invalid_iconv)
+                return convert(to_utf, s.data(), s.size());
+#endif
+            return boost::locale::conv::to_utf<char_type>(s, name);
+        }
+        string encode(const string_type &s) const
+        {
+#ifndef _WIN32
+            if (from_utf != invalid_iconv)
+                return convert(from_utf, s.data(), s.size());
+#endif
+            return boost::locale::conv::from_utf(s, name);
+        }
+
+        const string name;
+        const bool   utf8;
+        bool         ascii_compatible = false;
+#ifndef _WIN32
+        iconv_t      to_utf   = invalid_iconv;
+        iconv_t      from_utf = invalid_iconv;
+#endif
+    };
+}
+
+static const converter & lookup(const string &charset)
+{
+    thread_local unordered_map<string, unique_ptr<converter>> cache;
+    auto it = cache.find(charset);
+    if (it == cache.end())
+        it = cache.emplace(charset, make_unique<converter>(charset)).first;
+    return *it->second;
+}
+
+bool zz::charset::is_utf8(const string &charset)
+{
+    return lookup(charset).utf8;
+}
+
+string_type zz::charset::decode(const string &s, const string &charset)
+{
+    const auto &c = lookup(charset);
+    if (c.ascii_compatible && is_ascii(s.data(), s.size()))
+        return string_type(begin(s), end(s));
+    return c.utf8 ? decode_utf8(s) : c.decode(s);
+}
+
+string zz::charset::encode(const string_type &s, const string &charset)
+{
+    const auto &c = lookup(charset);
+    if (c.ascii_compatible && is_ascii(s.data(), s.size()))
+        return string(begin(s), end(s));
+    return c.utf8 ? encode_utf8(s) : c.encode(s);
+}
+
+string_type zz::charset::decode_utf8(const string &s)
+{
+    if (is_ascii(s.data(), s.size()))
+        return string_type(begin(s), end(s));
+    return boost::locale::conv::utf_to_utf<char_type>(s);
+}
+
+string zz::charset::encode_utf8(const string_type &s)
+{
+    if (is_ascii(s.data(), s.size()))
+        return string(begin(s), end(s));
+    return boost::locale::conv::utf_to_utf<char>(s);
+}
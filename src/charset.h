@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include "config.h"
+
+namespace zz::charset
+{
+    using char_type   = fs::path::value_type;
+    using string_type = fs::path::string_type;
+
+    template <typename char_type>
+    inline bool is_ascii(const char_type *s, size_t n) noexcept
+    {
+        if constexpr (sizeof(char_type) == 1) {
+            // eight bytes per step; the loop vectorizes well under -O3
+            constexpr uint64_t high_bits = 0x8080808080808080;
+            uint64_t acc = 0;
+            size_t i = 0;
+            for (; i + sizeof acc <= n; i += sizeof acc) {
+                uint64_t word;
+                std::memcpy(&word, s + i, sizeof word);
+                acc |= word;
+            }
+            for (; i < n; i++)
+                acc |= static_cast<uint8_t>(s[i]);
+            return (acc & high_bits) == 0;
+        } else {
+            std::make_unsigned_t<char_type> acc = 0;
+            for (size_t i = 0; i < n; i++)
+                acc |= static_cast<std::make_unsigned_t<char_type>>(s[i]) & ~0x7F;
+            return acc == 0;
+        }
+    }
+
+    bool is_utf8(const std::string &charset);
+
+    // converters are cached per thread and per charset name
+    string_type decode(const std::string &, const std::string &charset);
+    std::string encode(const string_type &, const std::string &charset);
+
+    string_type decode_utf8(const std::string &);
+    std::string encode_utf8(const string_type &);
+}
@@ -6,6 +6,7 @@ namespace zz
 {
     namespace fs
     {
+        using std::filesystem::directory_entry;
         using std::filesystem::directory_iterator;
         using std::filesystem::filesystem_error;
         using std::filesystem::path;
@@ -15,6 +16,7 @@ namespace zz
         using std::filesystem::is_directory;
         using std::filesystem::last_write_time;
         using std::filesystem::relative;
+        using std::filesystem::remove;
         using std::filesystem::rename;
     }
     namespace io
@@ -34,6 +36,7 @@ namespace zz
 {
     namespace fs
     {
+        using std::experimental::filesystem::directory_entry;
         using std::experimental::filesystem::directory_iterator;
         using std::experimental::filesystem::filesystem_error;
         using std::experimental::filesystem::path;
@@ -43,6 +46,7 @@ namespace zz
         using std::experimental::filesystem::is_directory;
         using std::experimental::filesystem::last_write_time;
         using std::experimental::filesystem::relative;
+        using std::experimental::filesystem::remove;
         using std::experimental::filesystem::rename;
     }
     namespace io
@@ -62,6 +66,7 @@ namespace zz
 {
     namespace fs
     {
+        using boost::filesystem::directory_entry;
         using boost::filesystem::directory_iterator;
         using boost::filesystem::filesystem_error;
         using boost::filesystem::path;
@@ -71,6 +76,7 @@ namespace zz
         using boost::filesystem::is_directory;
         using boost::filesystem::last_write_time;
         using boost::filesystem::relative;
+        using boost::filesystem::remove;
         using boost::filesystem::rename;
     }
     namespace io
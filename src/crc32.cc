@@ -0,0 +1,257 @@
+#include <array>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CRC32_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__)
+#define CRC32_ARMV8 1
+#include <arm_acle.h>
+#ifdef __linux__
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+#include "crc32.h"
+
+using namespace std;
+
+#ifdef __GNUC__
+#define TARGET(features) __attribute__((target(features)))
+#else
+#define TARGET(features)
+#endif
+
+using kernel_type = zz::detail::crc32_kernel;
+using kernel_list = vector<pair<const char *, kernel_type>>;
+
+static constexpr uint32_t polynomial = 0xEDB88320;
+
+static constexpr auto tables = [] {
+    array<array<uint32_t, 256>, 16> t = {};
+    for (uint32_t i = 0; i < 256; i++) {
+        auto c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? c >> 1 ^ polynomial : c >> 1;
+        t[0][i] = c;
+    }
+    for (size_t k = 1; k < t.size(); k++)
+        for (size_t i = 0; i < 256; i++)
+            t[k][i] = t[k - 1][i] >> 8 ^ t[0][t[k - 1][i] & 0xFF];
+    return t;
+}();
+
+static inline uint32_t load32(const uint8_t *p) noexcept
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+static uint32_t crc32_slice16(uint32_t crc, const uint8_t *p, size_t n) noexcept
+{
+    const auto &t = tables;
+    for (; n >= 16; p += 16, n -= 16) {
+        const auto a = load32(p) ^ crc, b = load32(p + 4), c = load32(p + 8), d = load32(p + 12);
+        crc = t[15][a & 0xFF] ^ t[14][a >> 8 & 0xFF] ^ t[13][a >> 16 & 0xFF] ^ t[12][a >> 24]
+            ^ t[11][b & 0xFF] ^ t[10][b >> 8 & 0xFF] ^ t[ 9][b >> 16 & 0xFF] ^ t[ 8][b >> 24]
+            ^ t[ 7][c & 0xFF] ^ t[ 6][c >> 8 & 0xFF] ^ t[ 5][c >> 16 & 0xFF] ^ t[ 4][c >> 24]
+            ^ t[ 3][d & 0xFF] ^ t[ 2][d >> 8 & 0xFF] ^ t[ 1][d >> 16 & 0xFF] ^ t[ 0][d >> 24];
+    }
+    for (; n; p++, n--)
+        crc = t[0][(crc ^ *p) & 0xFF] ^ crc >> 8;
+    return crc;
+}
+
+#ifdef CRC32_X86
+// Folding constants x^(D+32) and x^(D-32) mod P, bit-reflected, for a fold distance of D bits.
+// See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel, 2009.
+static constexpr uint64_t k2048[] = { 0x011542778A, 0x01322D1430 };
+static constexpr uint64_t k512[]  = { 0x0154442BD4, 0x01C6E41596 };
+static constexpr uint64_t k384[]  = { 0x003DB1ECDC, 0x0174359406 };
+static constexpr uint64_t k256[]  = { 0x00F1DA05AA, 0x015A546366 };
+static constexpr uint64_t k128[]  = { 0x01751997D0, 0x00CCAA009E };
+static constexpr uint64_t k64     =   0x0163CD6124;
+static constexpr uint64_t kpoly[] = { 0x01DB710641, 0x01F7011641 };
+
+TARGET("pclmul,sse4.1")
+static inline __m128i load128(const uint8_t *p) noexcept
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+TARGET("pclmul,sse4.1")
+static inline __m128i fold128(__m128i x, __m128i k, __m128i next) noexcept
+{
+    return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next);
+}
+
+// folds the remaining 16-byte blocks into x, then reduces the 128 bits to the CRC
+TARGET("pclmul,sse4.1")
+static uint32_t reduce128(__m128i x, const uint8_t *p, size_t n) noexcept
+{
+    const auto k = _mm_set_epi64x(k128[1], k128[0]);
+    for (; n >= 16; p += 16, n -= 16)
+        x = fold128(x, k, load128(p));
+
+    const auto mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    x = _mm_xor_si128(_mm_srli_si128(x, 8), _mm_clmulepi64_si128(x, k, 0x10));
+    x = _mm_xor_si128(_mm_srli_si128(x, 4),
+                      _mm_clmulepi64_si128(_mm_and_si128(x, mask), _mm_cvtsi64_si128(k64), 0x00));
+
+    const auto poly = _mm_set_epi64x(kpoly[1], kpoly[0]);
+    auto y = _mm_clmulepi64_si128(_mm_and_si128(x, mask), poly, 0x10);
+    y = _mm_clmulepi64_si128(_mm_and_si128(y, mask), poly, 0x00);
+    return static_cast<uint32_t>(_mm_extract_epi32(_mm_xor_si128(x, y), 1));
+}
+
+TARGET("pclmul,sse4.1")
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *p, size_t n) noexcept
+{
+    if (n < 64)
+        return crc32_slice16(crc, p, n);
+    auto x0 = _mm_xor_si128(load128(p), _mm_cvtsi32_si128(static_cast<int>(crc)));
+    auto x1 = load128(p + 16), x2 = load128(p + 32), x3 = load128(p + 48);
+    p += 64, n -= 64;
+
+    auto k = _mm_set_epi64x(k512[1], k512[0]);
+    for (; n >= 64; p += 64, n -= 64) {
+        x0 = fold128(x0, k, load128(p));
+        x1 = fold128(x1, k, load128(p + 16));
+        x2 = fold128(x2, k, load128(p + 32));
+        x3 = fold128(x3, k, load128(p + 48));
+    }
+
+    k = _mm_set_epi64x(k128[1], k128[0]);
+    x0 = fold128(x0, k, x1);
+    x0 = fold128(x0, k, x2);
+    x0 = fold128(x0, k, x3);
+
+    const auto m = n & ~size_t(15);
+    return crc32_slice16(reduce128(x0, p, m), p + m, n - m);
+}
+
+TARGET("avx512f,vpclmulqdq,pclmul,sse4.1")
+static inline __m512i load512(const uint8_t *p) noexcept
+{
+    return _mm512_loadu_si512(p);
+}
+
+TARGET("avx512f,vpclmulqdq,pclmul,sse4.1")
+static inline __m512i fold512(__m512i x, __m512i k, __m512i next) noexcept
+{
+    return _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(x, k, 0x00), _mm512_clmulepi64_epi128(x, k, 0x11), next, 0x96);
+}
+
+TARGET("avx512f,vpclmulqdq,pclmul,sse4.1")
+static uint32_t crc32_vpclmul(uint32_t crc, const uint8_t *p, size_t n) noexcept
+{
+    if (n < 256)
+        return crc32_pclmul(crc, p, n);
+    auto x0 = _mm512_xor_si512(load512(p), _mm512_maskz_set1_epi32(1, static_cast<int>(crc)));
+    auto x1 = load512(p + 64), x2 = load512(p + 128), x3 = load512(p + 192);
+    p += 256, n -= 256;
+
+    auto k = _mm512_set_epi64(k2048[1], k2048[0], k2048[1], k2048[0], k2048[1], k2048[0], k2048[1], k2048[0]);
+    for (; n >= 256; p += 256, n -= 256) {
+        x0 = fold512(x0, k, load512(p));
+        x1 = fold512(x1, k, load512(p + 64));
+        x2 = fold512(x2, k, load512(p + 128));
+        x3 = fold512(x3, k, load512(p + 192));
+    }
+
+    k = _mm512_set_epi64(k512[1], k512[0], k512[1], k512[0], k512[1], k512[0], k512[1], k512[0]);
+    x0 = fold512(x0, k, x1);
+    x0 = fold512(x0, k, x2);
+    x0 = fold512(x0, k, x3);
+    for (; n >= 64; p += 64, n -= 64)
+        x0 = fold512(x0, k, load512(p));
+
+    // the four lanes are 384, 256 and 128 bits away from the last one
+    k = _mm512_set_epi64(0, 0, k128[1], k128[0], k256[1], k256[0], k384[1], k384[0]);
+    const auto y = _mm512_xor_si512(_mm512_clmulepi64_epi128(x0, k, 0x00), _mm512_clmulepi64_epi128(x0, k, 0x11));
+    auto x = _mm512_maskz_extracti32x4_epi32(0xF, x0, 3);
+    x = _mm_xor_si128(x, _mm512_maskz_extracti32x4_epi32(0xF, y, 0));
+    x = _mm_xor_si128(x, _mm512_maskz_extracti32x4_epi32(0xF, y, 1));
+    x = _mm_xor_si128(x, _mm512_maskz_extracti32x4_epi32(0xF, y, 2));
+
+    const auto m = n & ~size_t(15);
+    return crc32_slice16(reduce128(x, p, m), p + m, n - m);
+}
+
+static kernel_list available_kernels()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    const bool pclmul = (info[2] & 1 << 1) && (info[2] & 1 << 19);
+    const bool osxsave = info[2] & 1 << 27;
+    __cpuidex(info, 7, 0);
+    const bool avx512 = osxsave && (info[1] & 1 << 16) && (info[2] & 1 << 10)
+                     && (_xgetbv(0) & 0xE6) == 0xE6;
+#else
+    __builtin_cpu_init();
+    const bool pclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    const bool avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("vpclmulqdq");
+#endif
+    kernel_list kernels{ { "slice16", crc32_slice16 } };
+    if (pclmul)
+        kernels.emplace_back("pclmul", crc32_pclmul);
+    if (pclmul && avx512)
+        kernels.emplace_back("vpclmul", crc32_vpclmul);
+    return kernels;
+}
+#elif defined CRC32_ARMV8
+#ifdef __clang__
+TARGET("crc")
+#else
+TARGET("+crc")
+#endif
+static uint32_t crc32_armv8(uint32_t crc, const uint8_t *p, size_t n) noexcept
+{
+    for (; n && reinterpret_cast<uintptr_t>(p) & 7; p++, n--)
+        crc = __crc32b(crc, *p);
+    for (; n >= 32; p += 32, n -= 32) {
+        const auto w = reinterpret_cast<const uint64_t *>(p);
+        crc = __crc32d(__crc32d(__crc32d(__crc32d(crc, w[0]), w[1]), w[2]), w[3]);
+    }
+    for (; n >= 8; p += 8, n -= 8)
+        crc = __crc32d(crc, *reinterpret_cast<const uint64_t *>(p));
+    for (; n; p++, n--)
+        crc = __crc32b(crc, *p);
+    return crc;
+}
+
+static kernel_list available_kernels()
+{
+#if defined __APPLE__
+    return { { "slice16", crc32_slice16 }, { "armv8", crc32_armv8 } };
+#elif defined __linux__
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+        return { { "slice16", crc32_slice16 }, { "armv8", crc32_armv8 } };
+    return { { "slice16", crc32_slice16 } };
+#else
+    return { { "slice16", crc32_slice16 } };
+#endif
+}
+#else
+static kernel_list available_kernels()
+{
+    return { { "slice16", crc32_slice16 } };
+}
+#endif
+
+kernel_list zz::detail::crc32_kernels()
+{
+    return available_kernels();
+}
+
+uint32_t zz::update_crc32(uint32_t crc, const void *data, size_t size) noexcept
+{
+    // the fastest one the machine has
+    static const auto kernel = available_kernels().back().second;
+    return ~kernel(~crc, static_cast<const uint8_t *>(data), size);
+}
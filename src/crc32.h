@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace zz
+{
+    /// Continues a CRC-32 (ISO-HDLC, as used by zip) over the given bytes.
+    uint32_t update_crc32(uint32_t crc, const void *data, size_t size) noexcept;
+
+    namespace detail
+    {
+        /// Continues a CRC-32 kept inverted, as the kernels do.
+        using crc32_kernel = uint32_t (*)(uint32_t, const uint8_t *, size_t) noexcept;
+
+        /// Every kernel this machine can run, by name, from the portable one to the fastest, which update_crc32 uses.
+        std::vector<std::pair<const char *, crc32_kernel>> crc32_kernels();
+    }
+
+    class crc32_t
+    {
+    public:
+        void process_bytes(const void *data, size_t size) noexcept
+        {
+            _crc = update_crc32(_crc, data, size);
+        }
+        uint32_t checksum() const noexcept
+        {
+            return _crc;
+        }
+        uint32_t operator () () const noexcept
+        {
+            return _crc;
+        }
+    private:
+        uint32_t _crc = 0;
+    };
+}
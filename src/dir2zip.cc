@@ -1,142 +1,328 @@
 #include <algorithm>
-#include <fstream>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
-
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable: 4244 4245)
-#endif
-#include <boost/crc.hpp>
-#ifdef _MSC_VER
-#pragma warning(pop)
+#include <thread>
+#include <unordered_map>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
 #endif
 
+#include "crc32.h"
+#include "dir_walker.h"
 #include "dostime.h"
+#include "file.h"
+#include "natural_sort.h"
 #include "path_ops.h"
 #include "pkzip_io.h"
 #include "strnatcmp.h"
+#include "zip_reader.h"
+#include "zip_writer.h"
 
 #include "dir2zip.h"
 
 using namespace zz;
 using namespace std;
 
-using crc32_t = boost::crc_32_type;
+// files up to this size are buffered whole; larger ones are passed to the writer piece by piece
+static constexpr size_t small_file_size = 1 << 20;
 
-template <typename output_iterator_type>
-static void enumerate_files(const fs::path &path, output_iterator_type files)
+// a file read ahead of the writer; either way its CRC goes in front of the data
+struct read_ahead
 {
-    for (const auto &entry : fs::directory_iterator(path)) {
-        if (entry.is_directory())
-            enumerate_files(entry.path(), files);
-        else if (entry.is_regular_file())
-            *files++ = entry.path();
+    bool                 ready = false;     // read to the end
+    exception_ptr        error;
+    vector<char>         data;              // a small file
+    deque<vector<char>>  chunks;            // the pieces of a large file the writer has not taken yet
+    uint32_t             crc32 = 0;
+};
+
+// the archive written next to the one it replaces, removed unless it took its place
+struct temporary_zip
+{
+    fs::path path;
+    bool     kept = false;
+
+    ~temporary_zip()
+    {
+        ec::error_code ec;
+        if (!kept && !path.empty())
+            fs::remove(path, ec);
     }
+};
+
+static inline auto process_id() noexcept
+{
+#ifdef _WIN32
+    return _getpid();
+#else
+    return getpid();
+#endif
 }
 
 void zz::dir2zip(const fs::path &path, const options &opts)
 {
+    auto &out = *opts.out;
     const auto dirname = path.filename();
 
     const auto zip_path = path.parent_path() / (path.filename() + ".zip");
-    io::ofstream zip;
-    zip.exceptions(ios::failbit | ios::badbit);
-    zip.open(zip_path, ios::binary);
-
-    vector<fs::path> files;
-    enumerate_files(path, back_inserter(files));
-    sort(begin(files), end(files), [](const fs::path &lhs, const fs::path &rhs) {
-        return strnatcasecmp(lhs.native(), rhs.native()) < 0;
-    });
-
-    vector<pkzip::central_file_header> records;
-    for (const auto &file : files) {
-        const auto size = fs::file_size(file);
-        if (size > std::numeric_limits<decltype(pkzip::local_file_header::compressed_size)>::max())
-            throw runtime_error("large file not supported: " + dirname);
-        const auto mtime = fs::last_write_time(file);
-
-        pkzip::local_file_header header(opts.charsets.second);
-        header.general_purpose_bit_flag = strnatcasecmp(header.charset, "utf8"s) == 0
-                                        ? pkzip::general_purpose_bit_flags::use_utf8
-                                        : 0;
-        header.compressed_size          = static_cast<decltype(header.compressed_size)>(size);
-        header.uncompressed_size        = static_cast<decltype(header.uncompressed_size)>(size);
-        header.file_name                = fs::relative(file, path);
-        replace(begin(header.file_name), end(header.file_name), '\\', '/');
-        if (any_of(begin(opts.excludes), end(opts.excludes), [&header](basic_string_view<pkzip::char_type> x)
-                   { return x.starts_with('*') ? header.file_name.ends_with(x.substr(1)) : header.file_name == x; }))
-            continue;
-        tie(header.last_mod_file_date, header.last_mod_file_time) = to_dos_date_time(mtime);
-
-        const streamoff offset = zip.tellp();
-        if (offset > numeric_limits<decltype(pkzip::central_file_header::relative_offset_of_local_header)>::max())
-            throw runtime_error("large file not supported: " + dirname);
-        zip << header;
 
+    // with --update, the entries of the archive being replaced whose file did not change are copied as they are,
+    // into a new archive that then takes its place
+    optional<zip_reader> previous;
+    optional<file> previous_file;
+    if (opts.update && fs::exists(zip_path)) {
+        // an archive that cannot be read is rebuilt in full
+        try {
+            previous.emplace(zip_path, opts.charsets.second);
+            previous_file.emplace(zip_path, file::read_only);
+        } catch (const exception &ex) {
+            previous.reset();
+            previous_file.reset();
+            if (!opts.quiet)
+                out << "   previous archive not reused: " << ex.what() << endl;
+        }
+    }
+    // named after the archive and the process, so that it meets neither a file of the user nor another run
+    temporary_zip tmp;
+    if (previous)
+        tmp.path = path.parent_path() / (zip_path.filename() + ".tmp-" + to_string(process_id()));
+    const auto &tmp_path = previous ? tmp.path : zip_path;
+    zip_writer zip(tmp_path);
+
+    auto files = walk_directory(path, exclude_matcher(opts.excludes), opts.jobs);
+    natural_sort(files, [](const walked_file &file) -> const auto & { return file.path.native(); }, opts.jobs);
+
+    vector<const pkzip::central_file_header *> reused(files.size());
+    if (previous) {
+        unordered_map<fs::path::string_type, const pkzip::central_file_header *> records;
+        for (const auto &record : previous->records())
+            records.emplace(record.file_name, &record);
+        for (size_t i = 0; i < files.size(); i++) {
+            const auto it = records.find(files[i].name);
+            if (it == end(records))
+                continue;
+            const auto &record = *it->second;
+            const auto [date, time] = to_dos_date_time(files[i].mtime);
+            if (record.compression_method == pkzip::compression_method::stored &&
+                !(record.general_purpose_bit_flag & pkzip::general_purpose_bit_flags::file_is_encrypted) &&
+                pkzip::get_compressed_size(record) == files[i].size &&
+                pkzip::get_uncompressed_size(record) == files[i].size &&
+                record.last_mod_file_date == date && record.last_mod_file_time == time)
+                reused[i] = &record;
+        }
+    }
+
+    // readers read the next files, small ones whole and large ones in pieces of buffer_size, while this thread
+    // writes them in order; they stay at most read_ahead files and read_ahead_memory bytes ahead, except that the
+    // file being written may always have one piece waiting
+    vector<read_ahead> ahead(files.size());
+    size_t next = 0, written = 0, buffered = 0;
+    auto stop = false;
+    mutex guard;
+    condition_variable wake;
+    const auto streamed = [&files, &reused](size_t i) {
+        return !reused[i] && files[i].size > small_file_size;
+    };
+    const auto cost = [&files, &reused](size_t i) {
+        return !reused[i] && files[i].size <= small_file_size ? static_cast<size_t>(files[i].size) : 0;
+    };
+    const auto fits = [&](size_t size) {
+        return buffered == 0 || buffered + size <= opts.read_ahead_memory;
+    };
+    // reads a large file into ahead[i], computing its CRC on the way; called with the lock held,
+    // returns with it held and may throw without it
+    const auto stream = [&](size_t i, unique_lock<mutex> &lock) {
+        lock.unlock();
+        file source(files[i].path, file::read_only);
+        source.will_read(files[i].size);
         crc32_t crc32;
+        for (uint64_t offset = 0; offset < files[i].size; ) {
+            const auto n = static_cast<size_t>(min<uint64_t>(opts.buffer_size, files[i].size - offset));
+            lock.lock();
+            wake.wait(lock, [&] { return stop || fits(n) || (i == written && ahead[i].chunks.empty()); });
+            if (stop)
+                return;
+            buffered += n;
+            lock.unlock();
+
+            vector<char> chunk(n);
+            if (source.read_at(data(chunk), n, offset) != n)
+                throw runtime_error("size changed while reading: " + files[i].path);
+            crc32.process_bytes(data(chunk), n);
+            offset += n;
+
+            lock.lock();
+            ahead[i].chunks.push_back(move(chunk));
+            lock.unlock();
+            wake.notify_all();
+        }
+        char extra;
+        if (source.read_at(&extra, 1, files[i].size))
+            throw runtime_error("size changed while reading: " + files[i].path);
+        lock.lock();
+        ahead[i].crc32 = crc32();
+    };
+    const auto read = [&] {
+        unique_lock lock(guard);
+        for (;;) {
+            wake.wait(lock, [&] {
+                return stop || next == files.size() || (next < written + opts.read_ahead && fits(cost(next)));
+            });
+            if (stop || next == files.size())
+                return;
+            const auto i = next++;
+            buffered += cost(i);
+
+            if (streamed(i)) {
+                try {
+                    stream(i, lock);
+                    if (stop)
+                        return;
+                } catch (...) {
+                    if (!lock.owns_lock())
+                        lock.lock();
+                    ahead[i].error = current_exception();
+                }
+                ahead[i].ready = true;
+                wake.notify_all();
+                continue;
+            }
+            lock.unlock();
+
+            read_ahead r;
+            try {
+                // the file of a reused entry is not even opened
+                if (!reused[i]) {
+                    const file source(files[i].path, file::read_only);
+                    r.data.resize(static_cast<size_t>(files[i].size));
+                    r.data.resize(source.read_at(data(r.data), size(r.data), 0));
+                    r.crc32 = update_crc32(0, data(r.data), size(r.data));
+                }
+            } catch (...) {
+                r.error = current_exception();
+            }
+
+            lock.lock();
+            r.ready  = true;
+            ahead[i] = move(r);
+            wake.notify_all();
+        }
+    };
+    vector<thread> readers;
+    const auto stop_readers = [&] {
         {
-            ifstream is(file, ios::binary);
-            for (char buf[8192]; auto n = is.read(buf, sizeof buf).gcount(); ) {
-                zip.write(buf, n);
-                crc32.process_bytes(buf, static_cast<size_t>(n));
+            lock_guard lock(guard);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto &reader : readers)
+            reader.join();
+    };
+    try {
+        for (size_t i = 0, n = max<size_t>(1, opts.jobs ? opts.jobs : thread::hardware_concurrency()); i < n; i++)
+            readers.emplace_back(read);
+        for (size_t i = 0; i < files.size(); i++) {
+            const auto &file = files[i];
+            pkzip::local_file_header header(opts.charsets.second);
+            header.general_purpose_bit_flag = strnatcasecmp(header.charset, "utf8"s) == 0
+                                            ? pkzip::general_purpose_bit_flags::use_utf8
+                                            : 0;
+            header.file_name                = file.name;
+            tie(header.last_mod_file_date, header.last_mod_file_time) = to_dos_date_time(file.mtime);
+
+            read_ahead r;
+            if (streamed(i)) {
+                // a large file is laid out first and its pieces written at their place as they come;
+                // its header goes out with the others when the archive is closed, by then with the CRC
+                const auto offset = zip.reserve_entry(header, file.size, file.size, 0);
+                for (uint64_t done = 0; ; ) {
+                    vector<char> chunk;
+                    {
+                        unique_lock lock(guard);
+                        wake.wait(lock, [&] { return ahead[i].ready || !ahead[i].chunks.empty(); });
+                        if (ahead[i].chunks.empty()) {
+                            r = move(ahead[i]);
+                            break;
+                        }
+                        chunk = move(ahead[i].chunks.front());
+                        ahead[i].chunks.pop_front();
+                    }
+                    zip.write_at(data(chunk), size(chunk), offset + done);
+                    done += size(chunk);
+                    {
+                        lock_guard lock(guard);
+                        buffered -= size(chunk);
+                    }
+                    wake.notify_all();
+                }
+                if (r.error)
+                    rethrow_exception(r.error);
+                zip.set_crc32(zip.entries() - 1, r.crc32);
+            } else {
+                {
+                    unique_lock lock(guard);
+                    wake.wait(lock, [&] { return ahead[i].ready; });
+                    r = move(ahead[i]);
+                }
+                if (r.error)
+                    rethrow_exception(r.error);
+
+                if (reused[i]) {
+                    // laid out exactly as if the file had been read again
+                    const auto &record = *reused[i];
+                    header.crc32 = record.crc32;
+                    zip.open_entry(header, file.size);
+                    zip.copy(*previous_file, previous->data_offset(record), file.size, record.crc32);
+                } else {
+                    // small files are read whole, so the CRC can go in front of the data
+                    header.crc32 = r.crc32;
+                    zip.open_entry(header, size(r.data));
+                    zip.write(data(r.data), size(r.data));
+                }
+                zip.close_entry();
+            }
+
+            {
+                lock_guard lock(guard);
+                written++;
+                buffered -= cost(i);
             }
+            wake.notify_all();
+
+            if (!opts.quiet)
+                out << "\r   " << dec << setw(3) << setfill('0') << zip.entries() << " entries written";
         }
-        header.crc32 = crc32();
-
-        const auto next_offset = zip.tellp();
-        zip.seekp(offset) << header;
-        zip.seekp(next_offset);
-
-        pkzip::central_file_header record(opts.charsets.second);
-        record.version_made_by                 = header.version_needed_to_extract | pkzip::version_made_by::msdos;
-        record.version_needed_to_extract       = header.version_needed_to_extract;
-        record.general_purpose_bit_flag        = header.general_purpose_bit_flag;
-        record.last_mod_file_time              = header.last_mod_file_time;
-        record.last_mod_file_date              = header.last_mod_file_date;
-        record.crc32                           = header.crc32;
-        record.compressed_size                 = header.compressed_size;
-        record.uncompressed_size               = header.uncompressed_size;
-        record.relative_offset_of_local_header = static_cast<decltype(record.relative_offset_of_local_header)>(offset);
-        record.file_name                       = header.file_name;
-        records.push_back(record);
-        if (records.size() > numeric_limits<decltype(pkzip::end_of_central_directory_record::total_number_of_entries_in_the_central_directory)>::max())
-            throw runtime_error("too many entries: " + dirname);
-
-        if (!opts.quiet)
-            cout << "\r   " << dec << setw(3) << setfill('0') << records.size() << " entries written";
+    } catch (...) {
+        stop_readers();
+        throw;
     }
+    stop_readers();
     if (!opts.quiet)
-        cout << endl;
-
-    const streamoff directory_offset = zip.tellp();
-    using offset_of_directory_type
-        = decltype(pkzip::end_of_central_directory_record
-            ::offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number);
-    if (directory_offset > numeric_limits<offset_of_directory_type>::max())
-        throw runtime_error("large file not supported: " + dirname);
-    for (const auto &record : records)
-        zip << record;
-    const streamoff directory_size = zip.tellp() - directory_offset;
-
-    pkzip::end_of_central_directory_record footer;
-    footer.total_number_of_entries_in_the_central_directory_on_this_disk
-        = static_cast<decltype(footer.total_number_of_entries_in_the_central_directory_on_this_disk)>(records.size());
-    footer.total_number_of_entries_in_the_central_directory
-        = static_cast<decltype(footer.total_number_of_entries_in_the_central_directory)>(records.size());
-    footer.size_of_the_central_directory
-        = static_cast<decltype(footer.size_of_the_central_directory)>(directory_size);
-    footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number
-        = static_cast<decltype(footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number)>(directory_offset);
-    zip << footer;
+        out << endl;
+
+    zip.close();
 
     if (!opts.quiet)
-        cout << "   footer written" << endl;
+        out << "   footer written" << endl;
 
-    zip.close();
+    if (previous) {
+        if (opts.verbose)
+            out << "   " << count_if(begin(reused), end(reused), [](const auto *record) { return record != nullptr; })
+                 << " unchanged entries reused" << endl;
+        previous->close();
+        previous_file->close();
+        fs::rename(tmp_path, zip_path);
+        tmp.kept = true;
+    }
 
     fs::last_write_time(zip_path, fs::last_write_time(path));
 }
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <utility>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include "dir_walker.h"
+
+using namespace zz;
+using namespace std;
+using namespace std::chrono;
+
+// reads the metadata of a file in one go; returns false if it is not a regular file
+static bool stat_file(const fs::directory_entry &entry, walked_file &file)
+{
+#if defined __linux__ && defined STATX_TYPE
+    struct statx st;
+    if (::statx(AT_FDCWD, entry.path().c_str(), 0, STATX_TYPE | STATX_SIZE | STATX_MTIME, &st) != 0) {
+        // a dangling symlink, or a file already gone
+        if (errno == ENOENT)
+            return false;
+        throw fs::filesystem_error("stat", entry.path(), ec::error_code(errno, ec::system_category()));
+    }
+    if (!S_ISREG(st.stx_mode))
+        return false;
+    file.size  = st.stx_size;
+    file.mtime = time_point_cast<file_clock::duration>(file_clock::from_sys(
+        sys_seconds(seconds(st.stx_mtime.tv_sec)) + nanoseconds(st.stx_mtime.tv_nsec)));
+    return true;
+#else
+    // Windows already has them from the directory listing
+    if (!entry.is_regular_file())
+        return false;
+    file.size  = entry.file_size();
+    file.mtime = entry.last_write_time();
+    return true;
+#endif
+}
+
+vector<walked_file> zz::walk_directory(const fs::path &root, const exclude_matcher &excluded, size_t jobs)
+{
+    using string_type = fs::path::string_type;
+
+    if (jobs == 0)
+        jobs = max(1u, thread::hardware_concurrency());
+
+    // the directories left to read, with the prefix of the names below them;
+    // each thread takes one whenever it is done with the last, and queues the subdirectories it finds
+    vector<pair<fs::path, string_type>> pending{ { root, string_type() } };
+    size_t busy = 0;
+    mutex guard;
+    condition_variable wake;
+    exception_ptr error;
+    vector<vector<walked_file>> found(jobs);
+
+    const auto work = [&](vector<walked_file> &files) {
+        unique_lock lock(guard);
+        for (;;) {
+            wake.wait(lock, [&] { return !pending.empty() || busy == 0 || error; });
+            if (pending.empty() || error)
+                break;
+            auto [dir, prefix] = move(pending.back());
+            pending.pop_back();
+            busy++;
+            lock.unlock();
+
+            vector<pair<fs::path, string_type>> subdirs;
+            try {
+                for (const auto &entry : fs::directory_iterator(dir)) {
+                    auto name = prefix + entry.path().filename().native();
+                    if (entry.is_directory()) {
+                        if (!excluded.excludes_tree(name))
+                            subdirs.emplace_back(entry.path(), move(name += '/'));
+                    } else if (!excluded(name)) {
+                        walked_file file{ entry.path(), move(name) };
+                        if (stat_file(entry, file))
+                            files.push_back(move(file));
+                    }
+                }
+            } catch (...) {
+                lock.lock();
+                if (!error)
+                    error = current_exception();
+                busy--;
+                break;
+            }
+
+            lock.lock();
+            busy--;
+            move(begin(subdirs), end(subdirs), back_inserter(pending));
+            wake.notify_all();
+        }
+        wake.notify_all();
+    };
+    vector<thread> workers;
+    for (size_t i = 1; i < jobs; i++)
+        workers.emplace_back(work, ref(found[i]));
+    work(found[0]);
+    for (auto &worker : workers)
+        worker.join();
+    if (error)
+        rethrow_exception(error);
+
+    auto &files = found[0];
+    for (size_t i = 1; i < jobs; i++)
+        move(begin(found[i]), end(found[i]), back_inserter(files));
+    return move(files);
+}
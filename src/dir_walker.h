@@ -0,0 +1,26 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "config.h"
+
+#include "exclude.h"
+
+namespace zz
+{
+    /// A regular file found under the directory being walked, with what the writer needs of its metadata.
+    struct walked_file
+    {
+        fs::path                                         path;
+        fs::path::string_type                            name;  // relative to the root, separated by '/'
+        uintmax_t                                        size;
+        std::chrono::time_point<std::chrono::file_clock> mtime;
+    };
+
+    /// Lists the regular files below root, in no particular order, reading directories on up to jobs threads
+    /// (0 for one per core). Excluded files are left out before their metadata is read, and directories whose
+    /// whole contents are excluded are not read at all.
+    std::vector<walked_file> walk_directory(const fs::path &root, const exclude_matcher &excluded, size_t jobs);
+}
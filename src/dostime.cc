@@ -1,3 +1,6 @@
+#include <ctime>
+#include <unordered_map>
+
 #include "dostime.h"
 
 using namespace std;
@@ -17,33 +20,48 @@ static inline auto to_dos_time(const hours &h, const minutes &m, const seconds &
     return static_cast<uint16_t>(h.count() << 11 | m.count() << 5 | s.count() >> 1);
 }
 
+// the offset of local time from UTC at the given time
+static seconds lookup_utc_offset(sys_seconds t)
+{
+#if _MSC_VER
+    return current_zone()->get_info(t).offset;
+#else
+    const auto time = system_clock::to_time_t(t);
+    tm local;
+    localtime_r(&time, &local);
+    return seconds(local.tm_gmtoff);
+#endif
+}
+
+// the same, looked up once per hour of UTC time and thread; an hour the offset changes in is never cached
+static seconds utc_offset(sys_seconds t)
+{
+    thread_local unordered_map<hours::rep, seconds> offsets;
+
+    const auto hour = floor<hours>(t);
+    if (const auto it = offsets.find(hour.time_since_epoch().count()); it != end(offsets))
+        return it->second;
+    const auto offset = lookup_utc_offset(hour);
+    if (offset != lookup_utc_offset(hour + hours(1) - seconds(1)))
+        return lookup_utc_offset(t);
+    offsets.emplace(hour.time_since_epoch().count(), offset);
+    return offset;
+}
+
 tuple<uint16_t, uint16_t> to_dos_date_time(const time_point<file_clock> &mtime)
 {
 #if _MSC_VER
-    const auto t = current_zone()->to_local(utc_clock::to_sys(file_clock::to_utc(mtime)));
+    const auto utc = floor<seconds>(utc_clock::to_sys(file_clock::to_utc(mtime)));
+#elif __apple_build_version__
+    const auto utc = sys_seconds(seconds(file_clock::to_time_t(mtime)));
+#else
+    const auto utc = floor<seconds>(file_clock::to_sys(mtime));
+#endif
+    const auto t = utc.time_since_epoch() + utc_offset(utc);
     const auto d = floor<days>(t);
-    const auto y = year_month_day(d);
+    const auto y = year_month_day(sys_days(d));
     const auto h = floor<hours>(t - d);
     const auto m = floor<minutes>(t - d - h);
     const auto s = floor<seconds>(t - d - h - m);
-#elif __apple_build_version__
-    const auto t = file_clock::to_time_t(mtime);
-    const auto u = duration_cast<system_clock::duration>(mtime.time_since_epoch())
-                 + seconds(localtime(&t)->tm_gmtoff);
-    const auto d = floor<days>(u);
-    const auto y = year_month_day(sys_days(d));
-    const auto h = floor<hours>(u - d);
-    const auto m = floor<minutes>(u - d - h);
-    const auto s = floor<seconds>(u - d - h - m);
-#else
-    const auto t = system_clock::to_time_t(time_point_cast<system_clock::duration>(file_clock::to_sys(mtime)));
-    const auto u = duration_cast<system_clock::duration>(mtime.time_since_epoch())
-                 + seconds(localtime(&t)->tm_gmtoff);
-    const auto d = floor<days>(u);
-    const auto y = year_month_day(sys_days(d));
-    const auto h = floor<hours>(u - d);
-    const auto m = floor<minutes>(u - d - h);
-    const auto s = floor<seconds>(u - d - h - m);
-#endif
     return make_tuple(to_dos_date(y.year(), y.month(), y.day()), to_dos_time(h, m, s));
 }
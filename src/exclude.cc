@@ -0,0 +1,188 @@
+#include <algorithm>
+
+#include "exclude.h"
+
+using namespace zz;
+using namespace std;
+
+static constexpr exclude_matcher::char_type globstar_suffix[] = { '/', '*', '*', 0 };
+
+static inline bool is_wildcard(exclude_matcher::char_type ch) noexcept
+{
+    return ch == '*' || ch == '?' || ch == '[';
+}
+
+exclude_matcher::exclude_matcher(const vector<string_type> &patterns)
+    : _suffixes(1)
+{
+    for (const string_view_type pattern : patterns) {
+        if (none_of(begin(pattern), end(pattern), is_wildcard)) {
+            _names.emplace(pattern);
+            continue;
+        }
+        if (pattern.starts_with('*') && none_of(begin(pattern) + 1, end(pattern), is_wildcard)) {
+            uint32_t node = 0;
+            for (auto it = rbegin(pattern); it != prev(rend(pattern)); ++it) {
+                auto &children = _suffixes[node].children;
+                const auto child = find_if(begin(children), end(children), [ch = *it](const auto &x) { return x.first == ch; });
+                if (child != end(children)) {
+                    node = child->second;
+                } else {
+                    children.emplace_back(*it, static_cast<uint32_t>(_suffixes.size()));
+                    node = static_cast<uint32_t>(_suffixes.size());
+                    _suffixes.emplace_back();
+                }
+            }
+            _suffixes[node].terminal = true;
+            continue;
+        }
+        add_glob(pattern);
+    }
+}
+
+void exclude_matcher::add_glob(string_view_type pattern)
+{
+    _globs.push_back(compile(pattern));
+    // "dir/**" takes everything below the directories that dir matches
+    if (pattern.size() > 3 && pattern.ends_with(string_view_type(globstar_suffix)))
+        _trees.push_back(compile(pattern.substr(0, pattern.size() - 3)));
+}
+
+bool exclude_matcher::operator () (string_view_type name) const
+{
+    if (_names.count(string_type(name)))
+        return true;
+
+    // walks the name backwards down the trie; any pattern ending on the way is a suffix of it
+    uint32_t node = 0;
+    for (auto it = rbegin(name); ; ++it) {
+        if (_suffixes[node].terminal)
+            return true;
+        if (it == rend(name))
+            break;
+        const auto &children = _suffixes[node].children;
+        const auto child = find_if(begin(children), end(children), [ch = *it](const auto &x) { return x.first == ch; });
+        if (child == end(children))
+            break;
+        node = child->second;
+    }
+
+    return any_of(begin(_globs), end(_globs), [name](const auto &glob) { return match(glob, name); });
+}
+
+bool exclude_matcher::excludes_tree(string_view_type directory) const
+{
+    return any_of(begin(_trees), end(_trees), [directory](const auto &glob) { return match(glob, directory); });
+}
+
+exclude_matcher::glob_type exclude_matcher::compile(string_view_type pattern)
+{
+    glob_type glob;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        glob_token token;
+        switch (pattern[i]) {
+        case '*':
+            if (i + 1 < pattern.size() && pattern[i + 1] == '*') {
+                token.kind = glob_token::globstar;
+                // a whole "**/" component may also match no directory at all
+                token.whole_dirs = i == 0 || pattern[i - 1] == '/';
+                for (i++; i + 1 < pattern.size() && pattern[i + 1] == '*'; i++)
+                    continue;
+                token.whole_dirs = token.whole_dirs && i + 1 < pattern.size() && pattern[i + 1] == '/';
+            } else {
+                token.kind = glob_token::star;
+            }
+            break;
+        case '?':
+            token.kind = glob_token::any;
+            break;
+        case '[': {
+            // a set without its closing bracket is taken literally
+            auto j = i + 1;
+            const auto negated = j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^');
+            if (negated)
+                j++;
+            const auto first = j;
+            for (; j < pattern.size() && (pattern[j] != ']' || j == first); j++)
+                continue;
+            if (j == pattern.size()) {
+                token.kind = glob_token::literal;
+                token.ch   = pattern[i];
+                break;
+            }
+            token.kind    = glob_token::set;
+            token.negated = negated;
+            for (auto k = first; k < j; k++) {
+                if (k + 2 < j && pattern[k + 1] == '-') {
+                    token.ranges.emplace_back(pattern[k], pattern[k + 2]);
+                    k += 2;
+                } else {
+                    token.ranges.emplace_back(pattern[k], pattern[k]);
+                }
+            }
+            i = j;
+            break;
+        }
+        default:
+            token.kind = glob_token::literal;
+            token.ch   = pattern[i];
+            break;
+        }
+        glob.push_back(move(token));
+    }
+    return glob;
+}
+
+bool exclude_matcher::glob_token::accepts(char_type c) const noexcept
+{
+    switch (kind) {
+    case literal:
+        return c == ch;
+    case any:
+    case star:
+        return c != '/';
+    case set:
+        return c != '/' && any_of(begin(ranges), end(ranges), [c](const auto &r) { return r.first <= c && c <= r.second; }) != negated;
+    case globstar:
+        return true;
+    }
+    return false;
+}
+
+// Runs the glob as an automaton whose states are token positions, so that no input is ever backtracked over.
+// A state is 1 when just entered and 2 when only a star matching on holds it.
+bool exclude_matcher::match(const glob_type &glob, string_view_type name)
+{
+    const auto n = glob.size();
+    vector<char> states(n + 1), next(n + 1);
+    const auto close = [&glob, n](vector<char> &s) {
+        // a star may match nothing, and a "**/" component just entered may be skipped with its slash
+        for (size_t i = 0; i < n; i++) {
+            if (s[i] && (glob[i].kind == glob_token::star || glob[i].kind == glob_token::globstar))
+                s[i + 1] = 1;
+            if (s[i] == 1 && glob[i].whole_dirs)
+                s[i + 2] = 1;
+        }
+    };
+    states[0] = 1;
+    close(states);
+    for (const auto c : name) {
+        fill(begin(next), end(next), 0);
+        auto alive = false;
+        for (size_t i = 0; i < n; i++) {
+            if (!states[i] || !glob[i].accepts(c))
+                continue;
+            const auto repeats = glob[i].kind == glob_token::star || glob[i].kind == glob_token::globstar;
+            if (!repeats)
+                next[i + 1] = 1;
+            else if (!next[i])
+                next[i] = 2;
+            alive = true;
+        }
+        if (!alive)
+            return false;
+        close(next);
+        swap(states, next);
+    }
+    return states[n] != 0;
+}
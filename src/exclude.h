@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+
+namespace zz
+{
+    /// The --exclude patterns, compiled once so that each name is tested against all of them in one go.
+    ///
+    /// A pattern without wildcards is an exact path, and "*suffix" matches any path ending in suffix.
+    /// Other patterns are globs over the whole path, where '?', "[...]" and '*' stop at '/' and "**" does not;
+    /// a "**/" component, leading or inner, may also match no directory at all, so "a/**/b" matches "a/b".
+    class exclude_matcher
+    {
+    public:
+        using char_type        = fs::path::value_type;
+        using string_type      = fs::path::string_type;
+        using string_view_type = std::basic_string_view<char_type>;
+
+        explicit exclude_matcher(const std::vector<string_type> &patterns);
+
+        bool operator () (string_view_type name) const;
+        /// Whether every path below the directory is excluded, so that it need not be read at all.
+        bool excludes_tree(string_view_type directory) const;
+    private:
+        // the suffixes, reversed into a trie
+        struct suffix_node
+        {
+            std::vector<std::pair<char_type, uint32_t>> children;
+            bool                                        terminal = false;
+        };
+
+        struct glob_token
+        {
+            enum kind_type : uint8_t { literal, any, set, star, globstar };
+
+            kind_type kind;
+            bool      negated    = false;
+            bool      whole_dirs = false;  // a globstar making up a "**/" component
+            char_type ch         = 0;
+            // inclusive ranges of a set
+            std::vector<std::pair<char_type, char_type>> ranges;
+
+            bool accepts(char_type) const noexcept;
+        };
+        using glob_type = std::vector<glob_token>;
+
+        void add_glob(string_view_type);
+        static glob_type compile(string_view_type);
+        static bool match(const glob_type &, string_view_type);
+
+        std::unordered_set<string_type> _names;
+        std::vector<suffix_node>        _suffixes;
+        std::vector<glob_type>          _globs;
+        std::vector<glob_type>          _trees;     // the directories of the "dir/**" globs
+    };
+}
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#endif
+#endif
+#include <vector>
+
+#include "file.h"
+
+using namespace zz;
+using namespace std;
+
+#ifdef _WIN32
+static const file::native_handle_type invalid_handle = INVALID_HANDLE_VALUE;
+
+static inline auto last_error() noexcept
+{
+    return ec::error_code(static_cast<int>(::GetLastError()), ec::system_category());
+}
+#else
+static constexpr file::native_handle_type invalid_handle = -1;
+
+static inline auto last_error() noexcept
+{
+    return ec::error_code(errno, ec::system_category());
+}
+#endif
+
+file::file(const fs::path &path, open_mode mode)
+    : _path(path)
+{
+#ifdef _WIN32
+    switch (mode) {
+    case read_only:
+        _handle = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        break;
+    case read_write:
+        _handle = ::CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        break;
+    default:
+        _handle = ::CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        break;
+    }
+#else
+    switch (mode) {
+    case read_only:
+        _handle = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        break;
+    case read_write:
+        _handle = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+        break;
+    default:
+        _handle = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        break;
+    }
+#endif
+    if (_handle == invalid_handle)
+        throw fs::filesystem_error("open", path, last_error());
+}
+
+file::~file() noexcept
+{
+    if (_handle == invalid_handle)
+        return;
+#ifdef _WIN32
+    ::CloseHandle(_handle);
+#else
+    ::close(_handle);
+#endif
+}
+
+size_t file::read_at(void *data, size_t size, uint64_t offset) const
+{
+    auto p = static_cast<char *>(data);
+    while (size) {
+#ifdef _WIN32
+        const auto n = static_cast<DWORD>(min<size_t>(size, numeric_limits<DWORD>::max()));
+        OVERLAPPED overlapped = {};
+        overlapped.Offset     = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD read = 0;
+        if (!::ReadFile(_handle, p, n, &read, &overlapped)) {
+            if (::GetLastError() == ERROR_HANDLE_EOF)
+                break;
+            throw fs::filesystem_error("read", _path, last_error());
+        }
+#else
+        const auto read = ::pread(_handle, p, min<size_t>(size, 1 << 30), static_cast<off_t>(offset));
+        if (read < 0) {
+            if (errno == EINTR)
+                continue;
+            throw fs::filesystem_error("read", _path, last_error());
+        }
+#endif
+        if (read == 0)
+            break;
+        p      += read;
+        size   -= static_cast<size_t>(read);
+        offset += static_cast<uint64_t>(read);
+    }
+    return static_cast<size_t>(p - static_cast<char *>(data));
+}
+
+void file::will_read(uint64_t size) noexcept
+{
+#if defined __linux__
+    ::posix_fadvise(_handle, 0, static_cast<off_t>(size), POSIX_FADV_SEQUENTIAL);
+    ::posix_fadvise(_handle, 0, static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+#elif defined __APPLE__
+    radvisory advisory = { 0, static_cast<int>(min<uint64_t>(size, numeric_limits<int>::max())) };
+    ::fcntl(_handle, F_RDADVISE, &advisory);
+#else
+    // Windows reads ahead of sequential reads on its own
+    (void)size;
+#endif
+}
+
+void file::write_at(const void *data, size_t size, uint64_t offset)
+{
+    auto p = static_cast<const char *>(data);
+    while (size) {
+#ifdef _WIN32
+        const auto n = static_cast<DWORD>(min<size_t>(size, numeric_limits<DWORD>::max()));
+        OVERLAPPED overlapped = {};
+        overlapped.Offset     = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        if (!::WriteFile(_handle, p, n, &written, &overlapped))
+            throw fs::filesystem_error("write", _path, last_error());
+#else
+        const auto written = ::pwrite(_handle, p, min<size_t>(size, 1 << 30), static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw fs::filesystem_error("write", _path, last_error());
+        }
+#endif
+        p      += written;
+        size   -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+}
+
+copy_method file::copy_range(const file &source, uint64_t source_offset, uint64_t size, uint64_t offset)
+{
+#ifdef __linux__
+    auto method = copy_method::none;
+
+    // a clone needs block-aligned offsets, and only whole blocks are shared; the rest is copied
+    if (struct stat st; ::fstat(_handle, &st) == 0 && st.st_blksize > 0) {
+        const auto block  = static_cast<uint64_t>(st.st_blksize);
+        const auto length = size / block * block;
+        if (length && source_offset % block == 0 && offset % block == 0) {
+            file_clone_range range = { source._handle, source_offset, length, offset };
+            if (::ioctl(_handle, FICLONERANGE, &range) == 0) {
+                source_offset += length;
+                offset        += length;
+                size          -= length;
+                method         = copy_method::clone;
+            }
+        }
+    }
+
+    while (size) {
+        auto in  = static_cast<loff_t>(source_offset);
+        auto out = static_cast<loff_t>(offset);
+        const auto n = ::copy_file_range(source._handle, &in, _handle, &out, min<uint64_t>(size, 1 << 30), 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+            if (method == copy_method::none)
+                return method;
+            // part of the range is already there, so the rest is copied here
+            vector<char> buf(min<uint64_t>(size, 1 << 20));
+            while (size) {
+                const auto r = ::pread(source._handle, buf.data(), min<uint64_t>(size, buf.size()), static_cast<off_t>(source_offset));
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r <= 0)
+                    throw fs::filesystem_error("read", source._path, r < 0 ? last_error() : ec::error_code(EIO, ec::system_category()));
+                write_at(buf.data(), static_cast<size_t>(r), offset);
+                source_offset += static_cast<uint64_t>(r);
+                offset        += static_cast<uint64_t>(r);
+                size          -= static_cast<uint64_t>(r);
+            }
+            return method;
+        }
+        if (n <= 0)
+            throw fs::filesystem_error("copy_file_range", source._path, n < 0 ? last_error() : ec::error_code(EIO, ec::system_category()));
+        source_offset += static_cast<uint64_t>(n);
+        offset        += static_cast<uint64_t>(n);
+        size          -= static_cast<uint64_t>(n);
+        if (method == copy_method::none)
+            method = copy_method::copy_file_range;
+    }
+    return method;
+#else
+    (void)source, (void)source_offset, (void)size, (void)offset;
+    return copy_method::none;
+#endif
+}
+
+void file::resize(uint64_t size)
+{
+#ifdef _WIN32
+    FILE_END_OF_FILE_INFO info = {};
+    info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    if (!::SetFileInformationByHandle(_handle, FileEndOfFileInfo, &info, sizeof info))
+#else
+    if (::ftruncate(_handle, static_cast<off_t>(size)) != 0)
+#endif
+        throw fs::filesystem_error("resize", _path, last_error());
+}
+
+bool file::allocate(uint64_t size)
+{
+#if defined _WIN32
+    FILE_ALLOCATION_INFO info = {};
+    info.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    return ::SetFileInformationByHandle(_handle, FileAllocationInfo, &info, sizeof info) != FALSE;
+#elif defined __linux__
+    if (::fallocate(_handle, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0)
+        return true;
+    if (errno == EOPNOTSUPP || errno == ENOSYS)
+        return false;
+    throw fs::filesystem_error("allocate", _path, last_error());
+#elif defined __APPLE__
+    fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0 };
+    if (::fcntl(_handle, F_PREALLOCATE, &store) == 0)
+        return true;
+    // contiguous space may not be available, any space will do
+    store.fst_flags = F_ALLOCATEALL;
+    return ::fcntl(_handle, F_PREALLOCATE, &store) == 0;
+#else
+    (void)size;
+    return false;
+#endif
+}
+
+void file::sync()
+{
+#ifdef _WIN32
+    if (!::FlushFileBuffers(_handle))
+#else
+    if (::fsync(_handle) != 0)
+#endif
+        throw fs::filesystem_error("sync", _path, last_error());
+}
+
+void file::sync_directory(const fs::path &path)
+{
+#ifndef _WIN32
+    // makes a new or renamed entry durable; NTFS journals its metadata on its own
+    file dir(path, read_only);
+    dir.sync();
+#else
+    (void)path;
+#endif
+}
+
+void file::close()
+{
+    if (_handle == invalid_handle)
+        return;
+    const auto handle = _handle;
+    _handle = invalid_handle;
+#ifdef _WIN32
+    if (!::CloseHandle(handle))
+#else
+    if (::close(handle) != 0)
+#endif
+        throw fs::filesystem_error("close", _path, last_error());
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+
+namespace zz
+{
+    /// How copy_range moved the bytes.
+    enum class copy_method
+    {
+        none,               // nothing copied; the caller has to copy by hand
+        clone,              // extents shared with the source (reflink)
+        copy_file_range,    // copied inside the kernel
+    };
+
+    /// File read and written at explicit offsets, so that several threads may use it at once.
+    class file
+    {
+        file(const file &) = delete;
+        file & operator = (const file &) = delete;
+    public:
+#ifdef _WIN32
+        using native_handle_type = void *;
+#else
+        using native_handle_type = int;
+#endif
+        enum open_mode
+        {
+            read_only,
+            read_write,         // the file must exist
+            create,             // truncates any existing file
+        };
+
+        explicit file(const fs::path &, open_mode = create);
+        ~file() noexcept;
+
+        /// Reads up to size bytes at the given offset, fewer only at the end of the file; safe to call from several threads.
+        size_t read_at(void *data, size_t size, uint64_t offset) const;
+        /// Tells the system that the first size bytes are about to be read in order, so it may start reading them now.
+        void will_read(uint64_t size) noexcept;
+
+        /// Writes all the bytes at the given offset; safe to call from several threads on disjoint ranges.
+        void write_at(const void *data, size_t size, uint64_t offset);
+
+        /// Copies a range of another file to the given offset without passing it through user space,
+        /// when the platform and the file systems allow it.
+        copy_method copy_range(const file &source, uint64_t source_offset, uint64_t size, uint64_t offset);
+
+        void resize(uint64_t size);
+        /// Reserves disk space for the file to grow to the given size, in as few extents as possible,
+        /// without changing its size. Returns false if the file system cannot do it.
+        bool allocate(uint64_t size);
+        /// Waits until the data written so far is on disk.
+        void sync();
+        static void sync_directory(const fs::path &);
+
+        void close();
+
+        native_handle_type native_handle() const noexcept
+        {
+            return _handle;
+        }
+    private:
+        fs::path           _path;
+        native_handle_type _handle;
+    };
+}
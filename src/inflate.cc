@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <new>
+
+#ifdef HAVE_ZLIB_NG
+#include <zlib-ng.h>
+#else
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include "inflate.h"
+
+using namespace zz;
+using namespace std;
+
+// A backend decodes a stream piece by piece with reset and read, and a whole one with inflate;
+// INFLATE_BACKEND decides which one inflate_backend names.
+namespace
+{
+    // zlib, or zlib-ng through its native API, which differs only in names and pointer types
+    class zlib_backend
+    {
+#ifdef HAVE_ZLIB_NG
+        using stream_type = zng_stream;
+        using byte_type   = const uint8_t;
+        static int  init(stream_type *s) noexcept { return zng_inflateInit2(s, -MAX_WBITS); }
+        static int  step(stream_type *s) noexcept { return zng_inflate(s, Z_NO_FLUSH); }
+        static void restart(stream_type *s) noexcept { zng_inflateReset(s); }
+        static void end(stream_type *s) noexcept { zng_inflateEnd(s); }
+#else
+        using stream_type = z_stream;
+        using byte_type   = Bytef;
+        static int  init(stream_type *s) noexcept { return inflateInit2(s, -MAX_WBITS); }
+        static int  step(stream_type *s) noexcept { return ::inflate(s, Z_NO_FLUSH); }
+        static void restart(stream_type *s) noexcept { inflateReset(s); }
+        static void end(stream_type *s) noexcept { inflateEnd(s); }
+#endif
+    public:
+        zlib_backend()
+        {
+            if (init(&_stream) != Z_OK)
+                throw bad_alloc();
+        }
+        zlib_backend(const zlib_backend &) = delete;
+        zlib_backend & operator = (const zlib_backend &) = delete;
+        ~zlib_backend()
+        {
+            end(&_stream);
+        }
+
+        void reset(string_view in) noexcept
+        {
+            restart(&_stream);
+            _stream.next_in  = reinterpret_cast<byte_type *>(const_cast<char *>(in.data()));
+            _stream.avail_in = 0;
+            _remaining = in.size();
+            _finished  = false;
+        }
+
+        bool read(void *out, size_t size, size_t &n) noexcept
+        {
+            n = 0;
+            if (_finished)
+                return true;
+            _stream.next_out  = static_cast<uint8_t *>(out);
+            _stream.avail_out = static_cast<uint32_t>(min<size_t>(size, UINT_MAX));
+            const auto requested = _stream.avail_out;
+            while (_stream.avail_out) {
+                // the input is handed over in pieces that fit in avail_in
+                if (_stream.avail_in == 0 && _remaining) {
+                    _stream.avail_in = static_cast<uint32_t>(min<size_t>(_remaining, UINT_MAX));
+                    _remaining -= _stream.avail_in;
+                }
+                const auto ret = step(&_stream);
+                if (ret == Z_STREAM_END) {
+                    _finished = true;
+                    break;
+                }
+                // Z_BUF_ERROR here means the input ran out before the end of the stream
+                if (ret != Z_OK)
+                    return false;
+            }
+            n = requested - _stream.avail_out;
+            return true;
+        }
+
+        bool inflate(string_view in, void *out, size_t size) noexcept
+        {
+            reset(in);
+            auto p = static_cast<char *>(out);
+            for (size_t n; size; p += n, size -= n)
+                if (!read(p, size, n) || n == 0)
+                    return false;
+            // the stream has to end right there
+            char extra;
+            size_t n;
+            return read(&extra, 1, n) && n == 0;
+        }
+    private:
+        stream_type _stream    = {};
+        size_t      _remaining = 0;     // input not yet handed to the stream
+        bool        _finished  = false;
+    };
+
+#ifdef HAVE_LIBDEFLATE
+    // libdeflate decodes whole buffers only, so streaming is left to zlib
+    class libdeflate_backend : public zlib_backend
+    {
+    public:
+        libdeflate_backend()
+            : _decompressor(libdeflate_alloc_decompressor())
+        {
+            if (!_decompressor)
+                throw bad_alloc();
+        }
+        ~libdeflate_backend()
+        {
+            libdeflate_free_decompressor(_decompressor);
+        }
+
+        bool inflate(string_view in, void *out, size_t size) noexcept
+        {
+            size_t actual = 0;
+            return libdeflate_deflate_decompress(_decompressor, in.data(), in.size(), out, size, &actual) == LIBDEFLATE_SUCCESS
+                && actual == size;
+        }
+    private:
+        libdeflate_decompressor *_decompressor;
+    };
+
+    using inflate_backend = libdeflate_backend;
+#else
+    using inflate_backend = zlib_backend;
+#endif
+}
+
+struct inflater::impl : inflate_backend
+{
+};
+
+inflater & inflater::get()
+{
+    thread_local inflater instance;
+    return instance;
+}
+
+inflater::inflater()
+    : _impl(make_unique<impl>())
+{
+}
+
+inflater::~inflater() noexcept = default;
+
+bool inflater::inflate(string_view in, void *out, size_t size)
+{
+    return _impl->inflate(in, out, size);
+}
+
+void inflater::reset(string_view in)
+{
+    _impl->reset(in);
+}
+
+bool inflater::read(void *out, size_t size, size_t &n)
+{
+    return _impl->read(out, size, n);
+}
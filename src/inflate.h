@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace zz
+{
+    /// Raw deflate decoder. The backend is chosen at build time with INFLATE_BACKEND: zlib, zlib-ng through
+    /// its native API, or libdeflate, which decodes whole buffers and leaves streaming to zlib.
+    class inflater
+    {
+        inflater(const inflater &) = delete;
+        inflater & operator = (const inflater &) = delete;
+    public:
+        /// The decoder of the calling thread; its state is reused from one entry to the next.
+        static inflater & get();
+
+        /// Decodes a whole stream into a buffer of exactly its uncompressed size.
+        /// Returns false if the data is invalid or does not fill the buffer exactly.
+        bool inflate(std::string_view in, void *out, size_t size);
+
+        /// Starts decoding a stream piece by piece with read.
+        void reset(std::string_view in);
+        /// Decodes up to size bytes; n is 0 at the end of the stream. Returns false if the data is invalid.
+        bool read(void *out, size_t size, size_t &n);
+
+        ~inflater() noexcept;
+    private:
+        inflater();
+
+        struct impl;
+        std::unique_ptr<impl> _impl;
+    };
+}
@@ -1,7 +1,16 @@
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <numeric>
 #include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
 #include <boost/program_options.hpp>
 
@@ -13,6 +22,7 @@
 #include "pdf2zip.h"
 #include "rar2zip.h"
 #include "zip2zip.h"
+#include "zip_reader.h"
 
 #ifdef _UNICODE
 #define tvalue wvalue
@@ -41,6 +51,220 @@ namespace std
     }
 }
 
+namespace zz
+{
+    static inline auto & operator >> (istream &in, crc_policy &value)
+    {
+        string s;
+        in >> s;
+        if (s == "fatal")
+            value = crc_policy::fatal;
+        else if (s == "skip")
+            value = crc_policy::skip;
+        else if (s == "warn")
+            value = crc_policy::warn;
+        else
+            in.setstate(ios::failbit);
+        return in;
+    }
+    static inline auto & operator << (ostream &out, const crc_policy &value)
+    {
+        switch (value) {
+        case crc_policy::fatal: return out << "fatal";
+        case crc_policy::skip:  return out << "skip";
+        case crc_policy::warn:  return out << "warn";
+        }
+        return out;
+    }
+    static inline auto & operator >> (istream &in, error_policy &value)
+    {
+        string s;
+        in >> s;
+        if (s == "abort")
+            value = error_policy::abort;
+        else if (s == "continue")
+            value = error_policy::keep_going;
+        else
+            in.setstate(ios::failbit);
+        return in;
+    }
+    static inline auto & operator << (ostream &out, const error_policy &value)
+    {
+        switch (value) {
+        case error_policy::abort:      return out << "abort";
+        case error_policy::keep_going: return out << "continue";
+        }
+        return out;
+    }
+}
+
+// how a conversion mostly weighs on the machine, so that each kind can be capped on its own
+enum class job_kind
+{
+    io,     // copies data as is: dir2zip, pdf2zip, zip2zip with stored entries only
+    cpu,    // decodes: rar2zip, zip2zip with deflated entries
+};
+
+struct job
+{
+    void   (*convert)(const fs::path &, const options &);
+    job_kind kind;
+};
+
+static job classify(const fs::path &path, const options &opts)
+{
+    if (!fs::exists(path))
+        throw runtime_error("file or directory not found: " + path.filename());
+    if (fs::is_directory(path))
+        return { dir2zip, job_kind::io };
+
+    uint32_t signature = 0;
+    {
+        io::ifstream file;
+        file.open(path, ios::binary);
+        file.read(reinterpret_cast<char *>(&signature), sizeof signature);
+    }
+    switch (signature) {
+    case pdf_signature:
+        // the JPEG streams are copied, not decoded
+        return { pdf2zip, job_kind::io };
+    case rar_signature:
+        return { rar2zip, job_kind::cpu };
+    case zip_signature:
+        // inflating is what weighs, and the central directory tells whether there is any;
+        // the kind only matters when several inputs are scheduled
+        if (opts.inputs != 1) {
+            try {
+                if (zip_reader::has_deflated_entries(path))
+                    return { zip2zip, job_kind::cpu };
+            } catch (const exception &) {
+                // the conversion reports what is wrong with the archive
+            }
+        }
+        return { zip2zip, job_kind::io };
+    }
+    return { nullptr, job_kind::io };
+}
+
+static string describe(const exception_ptr &error)
+{
+    try {
+        rethrow_exception(error);
+    } catch (const exception &ex) {
+        return ex.what();
+    } catch (...) {
+        return "unknown error";
+    }
+}
+
+// collects the output of a job run alongside others; a progress line rewritten after '\r' keeps only its last state
+class job_output : public streambuf
+{
+public:
+    const string & str() const noexcept
+    {
+        return _text;
+    }
+protected:
+    int_type overflow(int_type ch) override
+    {
+        if (traits_type::eq_int_type(ch, traits_type::eof()))
+            return traits_type::not_eof(ch);
+        if (traits_type::to_char_type(ch) == '\r')
+            _text.erase(_text.rfind('\n') + 1);
+        else
+            _text.push_back(traits_type::to_char_type(ch));
+        return ch;
+    }
+private:
+    string _text;
+};
+
+// Converts the inputs on up to opts.inputs threads, each kind of job capped on its own. The output of each job
+// is held back until it is done, then printed in one piece. Returns false if any input failed.
+static bool convert_all(const vector<fs::path> &paths, const options &opts)
+{
+    const auto workers = opts.inputs ? opts.inputs : max(1u, thread::hardware_concurrency());
+    const size_t caps[] = {
+        opts.io_inputs  ? opts.io_inputs  : workers,
+        opts.cpu_inputs ? opts.cpu_inputs : workers,
+    };
+
+    vector<size_t> pending(paths.size());
+    iota(begin(pending), end(pending), 0);
+    vector<job> jobs(paths.size());
+    vector<exception_ptr> errors(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        try {
+            jobs[i] = classify(paths[i], opts);
+        } catch (...) {
+            errors[i] = current_exception();
+        }
+    }
+
+    size_t running[size(caps)] = {};
+    auto failed = false;
+    exception_ptr abort;
+    mutex guard;
+    condition_variable wake;
+    const auto work = [&] {
+        unique_lock lock(guard);
+        for (;;) {
+            // the first input in line whose kind has room
+            auto it = end(pending);
+            wake.wait(lock, [&] {
+                it = find_if(begin(pending), end(pending), [&](size_t i) {
+                    return running[static_cast<size_t>(jobs[i].kind)] < caps[static_cast<size_t>(jobs[i].kind)];
+                });
+                return abort || pending.empty() || it != end(pending);
+            });
+            if (abort || pending.empty())
+                return;
+            const auto i = *it;
+            pending.erase(it);
+            const auto kind = static_cast<size_t>(jobs[i].kind);
+            running[kind]++;
+            lock.unlock();
+
+            job_output buffer;
+            ostream out(&buffer);
+            auto job_opts = opts;
+            job_opts.out  = &out;
+            auto error = errors[i];
+            if (!error && jobs[i].convert) {
+                try {
+                    jobs[i].convert(paths[i], job_opts);
+                } catch (...) {
+                    error = current_exception();
+                }
+            }
+
+            lock.lock();
+            running[kind]--;
+            if (!opts.quiet)
+                cout << (1 + i) << ". " << paths[i].filename() << endl;
+            cout << buffer.str() << flush;
+            if (error) {
+                failed = true;
+                if (opts.on_error == error_policy::abort && !abort)
+                    abort = error;
+                else
+                    cerr << "Error: " << (opts.quiet ? paths[i].filename() + ": " : string()) << describe(error) << endl;
+            }
+            wake.notify_all();
+        }
+    };
+    vector<thread> threads;
+    for (size_t i = 1; i < min(workers, paths.size()); i++)
+        threads.emplace_back(work);
+    work();
+    for (auto &thread : threads)
+        thread.join();
+    if (abort)
+        rethrow_exception(abort);
+    return !failed;
+}
+
 #ifdef _UNICODE
 int wmain(int argc, wchar_t *argv[])
 #else
@@ -53,9 +277,7 @@ try
     using char_type   = remove_pointer_t<remove_pointer_t<decltype(argv)>>;
     using string_type = basic_string<char_type>;
 
-    const auto patterns = zz::rar_exists()
-        ? "directory|*.pdf|*.rar|*.zip"
-        : "directory|*.pdf|*.zip";
+    const auto patterns = "directory|*.pdf|*.rar|*.zip";
     po::options_description desc(
         "Usage: " + fs::path(argv[0]).stem().string() + " [options] <" + patterns + ">...\n"
         "\n"
@@ -64,12 +286,34 @@ try
     desc.add_options()
         ("help,h"   , "print this help")
         ("quiet,q"  , "quiet mode")
+        ("verbose,V", "print how the data was copied")
         ("version,v", "print the version")
         ("charset,O", po::value(&opts.charsets)->value_name("IN,OUT")->default_value(opts.charsets),
                       "specify character encodings")
         ("exclude,x", po::tvalue(&opts.excludes)->value_name("PATTERN"),
-                      "exclude files with the given patterns")
-        ("rename,n" , "rename entries to sequential numbers");
+                      "exclude files with the given patterns (exact paths, *suffix, or globs with ?, [...], * and **)")
+        ("rename,n" , "rename entries to sequential numbers")
+        ("in-place,i", "rewrite stored zip files in place when only the headers change (the data is not read, so its CRC-32 is not checked)")
+        ("update,u" , "reuse the entries of an existing zip whose files did not change (directories only)")
+        ("buffer-size", po::value(&opts.buffer_size)->value_name("BYTES")->default_value(opts.buffer_size),
+                      "size of the buffer used to stream entries")
+        ("jobs,j"   , po::value(&opts.jobs)->value_name("N")->default_value(opts.jobs),
+                      "number of threads converting entries and sorting long lists (0 for one per core)")
+        ("read-ahead", po::value(&opts.read_ahead)->value_name("FILES")->default_value(opts.read_ahead),
+                      "number of files read ahead of the archive being written")
+        ("read-ahead-memory", po::value(&opts.read_ahead_memory)->value_name("BYTES")->default_value(opts.read_ahead_memory),
+                      "memory held by the files read ahead")
+        ("crc-mismatch", po::value(&opts.crc_policy)->value_name("fatal|skip|warn")->default_value(opts.crc_policy),
+                      "what to do with entries whose data does not match their CRC-32 (checked when the data is read, "
+                      "not when the kernel clones or copies it)")
+        ("inputs,J" , po::value(&opts.inputs)->value_name("N")->default_value(opts.inputs),
+                      "number of inputs converted at once (0 for one per core)")
+        ("io-inputs", po::value(&opts.io_inputs)->value_name("N")->default_value(opts.io_inputs),
+                      "at most N directories, pdf files and stored zip files at once (0 for no limit)")
+        ("cpu-inputs", po::value(&opts.cpu_inputs)->value_name("N")->default_value(opts.cpu_inputs),
+                      "at most N rar files and deflated zip files at once (0 for no limit)")
+        ("on-error" , po::value(&opts.on_error)->value_name("abort|continue")->default_value(opts.on_error),
+                      "whether the other inputs are still converted after one fails");
     vector<string_type> args;
     try {
         auto parsed = po::parse_command_line(argc, argv, desc);
@@ -87,46 +331,53 @@ try
         }
         if (vmap.count("quiet"))
             opts.quiet = true;
+        if (vmap.count("verbose"))
+            opts.verbose = true;
         if (vmap.count("rename"))
             opts.rename = true;
+        if (vmap.count("in-place"))
+            opts.in_place = true;
+        if (vmap.count("update"))
+            opts.update = true;
+        if (opts.buffer_size == 0)
+            throw invalid_argument("buffer-size");
+        if (opts.read_ahead == 0)
+            throw invalid_argument("read-ahead");
     } catch (...) {
         cerr << desc << endl;
         exit(2);
     }
 
-    for (auto it = begin(args); it != end(args); ++it) {
-        auto path = fs::path(it->ends_with('/') ? it->substr(0, it->size() - 1) : *it);
-        if (!fs::exists(path))
-            throw runtime_error("file or directory not found: " + path.filename());
+    vector<fs::path> paths;
+    for (const auto &arg : args)
+        paths.emplace_back(arg.ends_with('/') ? arg.substr(0, arg.size() - 1) : arg);
 
-        auto i = distance(begin(args), it);
-        if (!opts.quiet)
-            cout << (1 + i) << ". " << path.filename() << endl;
+    if (opts.inputs != 1)
+        return convert_all(paths, opts) ? 0 : 1;
 
-        if (fs::is_directory(path)) {
-            dir2zip(path, opts);
-            continue;
-        }
-        uint32_t signature = 0;
-        {
-            io::ifstream file;
-            file.open(path, ios::binary);
-            file.read(reinterpret_cast<char *>(&signature), sizeof signature);
-        }
-        switch (signature) {
-        case pdf_signature:
-            pdf2zip(path, opts);
-            break;
-        case rar_signature:
-            rar2zip(path, opts);
-            break;
-        case zip_signature:
-            zip2zip(path, opts);
-            break;
+    auto failed = false;
+    for (size_t i = 0; i < paths.size(); i++) {
+        const auto &path = paths[i];
+        auto started = false;
+        try {
+            const auto job = classify(path, opts);
+            if (!opts.quiet)
+                cout << (1 + i) << ". " << path.filename() << endl;
+            started = true;
+            if (job.convert)
+                job.convert(path, opts);
+        } catch (const exception &ex) {
+            if (opts.on_error == error_policy::abort)
+                throw;
+            // ends a progress line left open
+            if (started && !opts.quiet)
+                cout << endl;
+            cerr << "Error: " << ex.what() << endl;
+            failed = true;
         }
     }
 
-    return 0;
+    return failed ? 1 : 0;
 }
 #ifdef NDEBUG
 catch (const std::exception &ex)
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "strnatcmp.h"
+
+namespace zz
+{
+    /// Sorts items by name in the order of strnatcasecmp, items of equal names keeping their order.
+    /// Each name is turned into a key once; lists large enough are split among up to jobs threads
+    /// (0 for one per core), which sort their share, of at least min_share items, before the shares are merged.
+    template <typename value_type, typename name_function>
+    void natural_sort(std::vector<value_type> &items, name_function name_of, size_t jobs = 1, size_t min_share = 1 << 14)
+    {
+        const auto n = items.size();
+        if (jobs == 0)
+            jobs = std::max(1u, std::thread::hardware_concurrency());
+        const auto shares = std::max<size_t>(1, std::min(jobs, n / min_share));
+
+        std::vector<std::pair<std::string, size_t>> keys(n);
+        std::vector<size_t> bounds(shares + 1);
+        for (size_t i = 0; i <= shares; i++)
+            bounds[i] = n * i / shares;
+
+        std::mutex guard;
+        std::exception_ptr error;
+        const auto in_parallel = [&](size_t count, const auto &work) {
+            const auto run = [&](size_t i) {
+                try {
+                    work(i);
+                } catch (...) {
+                    std::lock_guard lock(guard);
+                    if (!error)
+                        error = std::current_exception();
+                }
+            };
+            std::vector<std::thread> workers;
+            for (size_t i = 1; i < count; i++)
+                workers.emplace_back(run, i);
+            run(0);
+            for (auto &worker : workers)
+                worker.join();
+            if (error)
+                std::rethrow_exception(error);
+        };
+
+        in_parallel(shares, [&](size_t share) {
+            for (auto i = bounds[share]; i < bounds[share + 1]; i++)
+                keys[i] = { strnatcasekey(name_of(items[i])), i };
+            std::sort(keys.begin() + bounds[share], keys.begin() + bounds[share + 1]);
+        });
+        for (size_t width = 1; width < shares; width *= 2) {
+            in_parallel((shares + 2 * width - 1) / (2 * width), [&](size_t pair) {
+                const auto first = pair * 2 * width;
+                if (first + width < shares)
+                    std::inplace_merge(keys.begin() + bounds[first], keys.begin() + bounds[first + width],
+                                       keys.begin() + bounds[std::min(first + 2 * width, shares)]);
+            });
+        }
+
+        std::vector<value_type> sorted;
+        sorted.reserve(n);
+        for (const auto &key : keys)
+            sorted.push_back(std::move(items[key.second]));
+        items = std::move(sorted);
+    }
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <iostream>
 #include <string>
 #include <vector>
 
@@ -7,11 +8,39 @@
 
 namespace zz
 {
+    /// What zip2zip does with an entry whose data does not match its CRC-32.
+    enum class crc_policy
+    {
+        fatal,
+        skip,
+        warn,
+    };
+
+    /// What happens to the other inputs when one of them fails.
+    enum class error_policy
+    {
+        abort,
+        keep_going,
+    };
+
     struct options
     {
-        bool                                quiet    = false;
-        std::pair<std::string, std::string> charsets = { "cp932", "utf8" };
-        std::vector<fs::path::string_type>  excludes = {};
-        bool                                rename   = false;
+        bool                                quiet             = false;
+        bool                                verbose           = false;
+        std::pair<std::string, std::string> charsets          = { "cp932", "utf8" };
+        std::vector<fs::path::string_type>  excludes          = {};
+        bool                                rename            = false;
+        bool                                in_place          = false;
+        bool                                update            = false;
+        size_t                              buffer_size       = 1 << 20;
+        size_t                              jobs              = 1;
+        size_t                              read_ahead        = 64;
+        size_t                              read_ahead_memory = 64 << 20;
+        zz::crc_policy                      crc_policy        = crc_policy::fatal;
+        size_t                              inputs            = 1;
+        size_t                              io_inputs         = 0;
+        size_t                              cpu_inputs        = 0;
+        zz::error_policy                    on_error          = error_policy::abort;
+        std::ostream                       *out               = &std::cout;     // where the progress goes
     };
 }
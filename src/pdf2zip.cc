@@ -10,16 +10,17 @@
 #pragma warning(push)
 #pragma warning(disable: 4244 4245)
 #endif
-#include <boost/crc.hpp>
 #include <boost/interprocess/streams/bufferstream.hpp>
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
+#include "crc32.h"
 #include "dostime.h"
 #include "path_ops.h"
 #include "pkzip_io.h"
 #include "strnatcmp.h"
+#include "zip_writer.h"
 
 #include "pdf2zip.h"
 
@@ -33,13 +34,6 @@ static inline auto is_crlf(char ch)
     return ch == '\r' || ch == '\n';
 }
 
-static inline auto compute_crc32(const void *data, size_t size)
-{
-    boost::crc_32_type crc;
-    crc.process_bytes(data, size);
-    return crc.checksum();
-}
-
 static inline auto make_file_name(size_t object_num, const char *extension)
 {
     basic_ostringstream<pkzip::char_type> ss;
@@ -49,6 +43,7 @@ static inline auto make_file_name(size_t object_num, const char *extension)
 
 void zz::pdf2zip(const fs::path &path, const options &opts)
 {
+    auto &out = *opts.out;
     const auto filename = path.filename();
     const auto mtime = fs::last_write_time(path);
 
@@ -124,22 +119,18 @@ void zz::pdf2zip(const fs::path &path, const options &opts)
         // JPEG
         if (meta.find("/DCTDecode") != string_view::npos) {
             const auto stream_view = object_view.substr(stream, endstream - stream);
-            if (stream_view.size() > numeric_limits<decltype(pkzip::local_file_header::compressed_size)>::max())
-                throw runtime_error("large file not supported: " + filename);
 
             pkzip::local_file_header header(opts.charsets.second);
             header.general_purpose_bit_flag = strnatcasecmp(header.charset, "utf8"s) == 0
                                             ? pkzip::general_purpose_bit_flags::use_utf8
                                             : 0;
-            header.crc32                    = compute_crc32(stream_view.data(), stream_view.size());
-            header.compressed_size          = static_cast<decltype(header.compressed_size)>(stream_view.size());
-            header.uncompressed_size        = static_cast<decltype(header.uncompressed_size)>(stream_view.size());
+            header.crc32                    = update_crc32(0, stream_view.data(), stream_view.size());
             header.file_name                = make_file_name(1 + entries.size(), ".jpg");
             tie(header.last_mod_file_date, header.last_mod_file_time) = to_dos_date_time(mtime);
             entries.push_back({ header, stream_view });
 
             if (!opts.quiet)
-                cout << "\r   " << dec << setw(3) << setfill('0') << entries.size() << " entries found";
+                out << "\r   " << dec << setw(3) << setfill('0') << entries.size() << " entries found";
             continue;
         }
 
@@ -149,70 +140,32 @@ void zz::pdf2zip(const fs::path &path, const options &opts)
         //}
     }
     if (!opts.quiet)
-        cout << endl;
+        out << endl;
 
     const auto zip_path = path.parent_path() / path.filename().replace_extension(".zip");
-    io::ofstream zip;
-    zip.exceptions(ios::failbit | ios::badbit);
-    zip.open(zip_path, ios::binary);
-
-    const auto zip_name = zip_path.filename();
-
-    vector<pkzip::central_file_header> records;
-    for (const auto &entry : entries) {
-        const streamoff offset = zip.tellp();
-        if (offset > numeric_limits<decltype(pkzip::central_file_header::relative_offset_of_local_header)>::max())
-            throw runtime_error("large file not supported: " + filename);
-
-        pkzip::central_file_header record(opts.charsets.second);
-        record.version_made_by                 = entry.header.version_needed_to_extract | pkzip::version_made_by::msdos;
-        record.version_needed_to_extract       = entry.header.version_needed_to_extract;
-        record.general_purpose_bit_flag        = entry.header.general_purpose_bit_flag;
-        record.last_mod_file_time              = entry.header.last_mod_file_time;
-        record.last_mod_file_date              = entry.header.last_mod_file_date;
-        record.crc32                           = entry.header.crc32;
-        record.compressed_size                 = entry.header.compressed_size;
-        record.uncompressed_size               = entry.header.uncompressed_size;
-        record.relative_offset_of_local_header = static_cast<decltype(record.relative_offset_of_local_header)>(offset);
-        record.file_name                       = entry.header.file_name;
-        records.push_back(record);
-
-        zip << entry.header;
-        zip.write(entry.stream.data(), entry.stream.size());
+    zip_writer zip(zip_path);
+
+    // every size is known, so the whole archive is laid out and allocated before the data goes in
+    vector<uint64_t> offsets;
+    offsets.reserve(entries.size());
+    for (const auto &entry : entries)
+        offsets.push_back(zip.reserve_entry(entry.header, entry.stream.size(), entry.stream.size(), 0));
+    zip.preallocate();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        zip.write_at(entries[i].stream.data(), entries[i].stream.size(), offsets[i]);
 
         if (!opts.quiet)
-            cout << "\r   " << dec << setw(3) << setfill('0') << records.size() << " entries written";
+            out << "\r   " << dec << setw(3) << setfill('0') << (1 + i) << " entries written";
     }
     if (!opts.quiet)
-        cout << endl;
+        out << endl;
 
+    zip.close();
     pdf.clear();
 
-    const streamoff directory_offset = zip.tellp();
-    using offset_of_directory_type
-        = decltype(pkzip::end_of_central_directory_record
-            ::offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number);
-    if (directory_offset > numeric_limits<offset_of_directory_type>::max())
-        throw runtime_error("large file not supported: " + filename);
-    for (const auto &record : records)
-        zip << record;
-    const streamoff directory_size = zip.tellp() - directory_offset;
-
-    pkzip::end_of_central_directory_record footer;
-    footer.total_number_of_entries_in_the_central_directory_on_this_disk
-        = static_cast<decltype(footer.total_number_of_entries_in_the_central_directory_on_this_disk)>(records.size());
-    footer.total_number_of_entries_in_the_central_directory
-        = static_cast<decltype(footer.total_number_of_entries_in_the_central_directory)>(records.size());
-    footer.size_of_the_central_directory
-        = static_cast<decltype(footer.size_of_the_central_directory)>(directory_size);
-    footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number
-        = static_cast<decltype(footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number)>(directory_offset);
-    zip << footer;
-
     if (!opts.quiet)
-        cout << "   footer written" << endl;
-
-    zip.close();
+        out << "   footer written" << endl;
 
     fs::last_write_time(zip_path, mtime);
 }
@@ -22,6 +22,7 @@ namespace zz::pkzip
     namespace version_needed_to_extract
     {
         constexpr uint16_t default_value = 10;
+        constexpr uint16_t zip64         = 45;
     }
 
     namespace general_purpose_bit_flags
@@ -37,6 +38,11 @@ namespace zz::pkzip
         constexpr uint16_t deflated = 8;
     }
 
+    namespace header_id
+    {
+        constexpr uint16_t zip64_extended_information = 0x0001;
+    }
+
     namespace msdos
     {
         constexpr uint32_t file_attribute_directory = 0x00000010;
@@ -77,6 +83,8 @@ namespace zz::pkzip
         }
     };
 
+    constexpr uint32_t data_descriptor_signature = 'P' | 'K' << 8 | 7 << 16 | 8 << 24;
+
     constexpr uint32_t central_file_header_signature = 'P' | 'K' << 8 | 1 << 16 | 2 << 24;
 
     struct central_file_header
@@ -143,4 +151,48 @@ namespace zz::pkzip
             return signature != end_of_central_directory_record_signature;
         }
     };
+
+    constexpr uint32_t zip64_end_of_central_directory_record_signature = 'P' | 'K' << 8 | 6 << 16 | 6 << 24;
+
+    struct zip64_end_of_central_directory_record
+    {
+        uint32_t signature                                                                     = zip64_end_of_central_directory_record_signature;
+        uint64_t size_of_zip64_end_of_central_directory_record                                 = 44;
+        uint16_t version_made_by                                                               = version_needed_to_extract::zip64 | version_made_by::msdos;
+        uint16_t version_needed_to_extract                                                     = version_needed_to_extract::zip64;
+        uint32_t number_of_this_disk                                                           = 0;
+        uint32_t number_of_the_disk_with_the_start_of_the_central_directory                    = 0;
+        uint64_t total_number_of_entries_in_the_central_directory_on_this_disk                 = 0;
+        uint64_t total_number_of_entries_in_the_central_directory                              = 0;
+        uint64_t size_of_the_central_directory                                                 = 0;
+        uint64_t offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number = 0;
+
+        explicit operator bool() const noexcept
+        {
+            return signature == zip64_end_of_central_directory_record_signature;
+        }
+        bool operator ! () const noexcept
+        {
+            return signature != zip64_end_of_central_directory_record_signature;
+        }
+    };
+
+    constexpr uint32_t zip64_end_of_central_directory_locator_signature = 'P' | 'K' << 8 | 6 << 16 | 7 << 24;
+
+    struct zip64_end_of_central_directory_locator
+    {
+        uint32_t signature                                                               = zip64_end_of_central_directory_locator_signature;
+        uint32_t number_of_the_disk_with_the_start_of_the_zip64_end_of_central_directory = 0;
+        uint64_t relative_offset_of_the_zip64_end_of_central_directory_record            = 0;
+        uint32_t total_number_of_disks                                                   = 1;
+
+        explicit operator bool() const noexcept
+        {
+            return signature == zip64_end_of_central_directory_locator_signature;
+        }
+        bool operator ! () const noexcept
+        {
+            return signature != zip64_end_of_central_directory_locator_signature;
+        }
+    };
 }
@@ -1,74 +1,56 @@
 #include <algorithm>
-#ifdef __GNUC__
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-#endif
-#include <boost/locale/encoding.hpp>
-#include <boost/locale/util.hpp>
-#ifdef __GNUC__
-#pragma GCC diagnostic pop
-#endif
-
-#include "strnatcmp.h"
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
 
+#include "charset.h"
 #include "pkzip_io.h"
+#include "pkzip_layout.h"
 
 using namespace std;
 
-using boost::locale::conv::from_utf;
-using boost::locale::conv::to_utf;
-using boost::locale::conv::utf_to_utf;
-using boost::locale::util::get_system_locale;
-
-static const string utf8_charsets[] = { "CP65001", "UTF-8", "UTF8" };
-
-static inline auto is_utf8(const string &charset)
-{
-    auto pred = [&charset](const string &s) { return strnatcasecmp(s, charset) == 0; };
-    return find_if(begin(utf8_charsets), end(utf8_charsets), pred) != end(utf8_charsets);
-}
+using zz::charset::decode;
+using zz::charset::decode_utf8;
+using zz::charset::encode;
+using zz::charset::encode_utf8;
+using zz::charset::is_utf8;
 
 static inline auto read(istream &is, void *data, size_t size)
 {
     return is.read(static_cast<char *>(data), size)
         && is.gcount() == static_cast<streamsize>(size);
 }
-template <typename value_type>
-static inline auto read(istream &is, value_type &value)
+template <typename record_type, typename layout_type = zz::pkzip::layout<record_type>>
+static inline auto read(istream &is, record_type &record, uint8_t (&buffer)[layout_type::size])
 {
-    return read(is, &value, sizeof value);
+    // the signature is read first so that a short trailing record never trips the stream
+    constexpr auto signature_size = sizeof record.signature;
+    if (!read(is, buffer, signature_size))
+        return false;
+    record.signature = zz::pkzip::detail::load_le<decltype(record.signature)>(buffer);
+    if (!record || !read(is, buffer + signature_size, layout_type::size - signature_size))
+        return false;
+    layout_type::decode(buffer, record);
+    return true;
 }
 
 static inline auto write(ostream &os, const void *data, size_t size)
 {
-    os.write(static_cast<const char *>(data), size);
-}
-template <typename value_type>
-static inline auto write(ostream &os, const value_type &value)
-{
-    write(os, &value, sizeof value);
+    if (size)
+        os.write(static_cast<const char *>(data), size);
 }
 
 istream & zz::pkzip::operator >> (istream &is, local_file_header &header)
 {
-    if (!read(is, header.signature) || !header ||
-        !read(is, header.version_needed_to_extract) ||
-        !read(is, header.general_purpose_bit_flag) ||
-        !read(is, header.compression_method) ||
-        !read(is, header.last_mod_file_time) ||
-        !read(is, header.last_mod_file_date) ||
-        !read(is, header.crc32) ||
-        !read(is, header.compressed_size) ||
-        !read(is, header.uncompressed_size) ||
-        !read(is, header.file_name_length) || header.file_name_length == 0 ||
-        !read(is, header.extra_field_length))
+    uint8_t buffer[layout<local_file_header>::size];
+    if (!read(is, header, buffer) || header.file_name_length == 0)
         return is;
 
     string file_name(header.file_name_length, '\0');
     if (!read(is, &file_name[0], header.file_name_length))
         return is;
     const auto use_utf8 = header.general_purpose_bit_flag & general_purpose_bit_flags::use_utf8;
-    header.file_name = use_utf8 ? utf_to_utf<char_type>(file_name) : to_utf<char_type>(file_name, header.charset);
+    header.file_name = use_utf8 ? decode_utf8(file_name) : decode(file_name, header.charset);
     if (header.extra_field_length) {
         header.extra_field.resize(header.extra_field_length);
         if (!read(is, &header.extra_field[0], header.extra_field_length))
@@ -83,24 +65,20 @@ ostream & zz::pkzip::operator << (ostream &os, const local_file_header &header)
     if ((general_purpose_bit_flag & general_purpose_bit_flags::use_utf8) == 0 && is_utf8(header.charset))
         general_purpose_bit_flag |= general_purpose_bit_flags::use_utf8;
     const auto use_utf8 = general_purpose_bit_flag & general_purpose_bit_flags::use_utf8;
-    const auto file_name = use_utf8 ? utf_to_utf<char>(header.file_name) : from_utf(header.file_name, header.charset);
+    const auto file_name = use_utf8 ? encode_utf8(header.file_name) : encode(header.file_name, header.charset);
     if (file_name.size() > numeric_limits<decltype(header.file_name_length)>::max())
         throw runtime_error("too long file name: " + file_name);
     if (header.extra_field.size() > numeric_limits<decltype(header.extra_field_length)>::max())
         throw runtime_error("too long extra field: " + file_name);
 
-    write(os, header.signature);
-    write(os, header.version_needed_to_extract);
-    write(os, general_purpose_bit_flag);
-    write(os, header.compression_method);
-    write(os, header.last_mod_file_time);
-    write(os, header.last_mod_file_date);
-    write(os, header.crc32);
-    write(os, header.compressed_size);
-    write(os, header.uncompressed_size);
-    write(os, static_cast<decltype(header.file_name_length)>(file_name.size()));
-    write(os, static_cast<decltype(header.extra_field_length)>(header.extra_field.size()));
+    using layout_type = layout<local_file_header>;
+    uint8_t buffer[layout_type::size];
+    layout_type::encode(buffer, header);
+    layout_type::put<&local_file_header::general_purpose_bit_flag>(buffer, general_purpose_bit_flag);
+    layout_type::put<&local_file_header::file_name_length>(buffer, static_cast<uint16_t>(file_name.size()));
+    layout_type::put<&local_file_header::extra_field_length>(buffer, static_cast<uint16_t>(header.extra_field.size()));
 
+    write(os, buffer, sizeof buffer);
     write(os, file_name.data(), file_name.size());
     write(os, header.extra_field.data(), header.extra_field.size());
     return os;
@@ -108,30 +86,15 @@ ostream & zz::pkzip::operator << (ostream &os, const local_file_header &header)
 
 istream & zz::pkzip::operator >> (istream &is, central_file_header &header)
 {
-    if (!read(is, header.signature) || !header ||
-        !read(is, header.version_made_by) ||
-        !read(is, header.version_needed_to_extract) ||
-        !read(is, header.general_purpose_bit_flag) ||
-        !read(is, header.compression_method) ||
-        !read(is, header.last_mod_file_time) ||
-        !read(is, header.last_mod_file_date) ||
-        !read(is, header.crc32) ||
-        !read(is, header.compressed_size) ||
-        !read(is, header.uncompressed_size) ||
-        !read(is, header.file_name_length) || header.file_name_length == 0 ||
-        !read(is, header.extra_field_length) ||
-        !read(is, header.file_comment_length) ||
-        !read(is, header.disk_number_start) ||
-        !read(is, header.internal_file_attributes) ||
-        !read(is, header.external_file_attributes) ||
-        !read(is, header.relative_offset_of_local_header))
+    uint8_t buffer[layout<central_file_header>::size];
+    if (!read(is, header, buffer) || header.file_name_length == 0)
         return is;
 
     string file_name(header.file_name_length, '\0');
     if (!is.read(&file_name[0], header.file_name_length))
         return is;
     const auto use_utf8 = header.general_purpose_bit_flag & general_purpose_bit_flags::use_utf8;
-    header.file_name = use_utf8 ? utf_to_utf<char_type>(file_name) : to_utf<char_type>(file_name, header.charset);
+    header.file_name = use_utf8 ? decode_utf8(file_name) : decode(file_name, header.charset);
     if (header.extra_field_length) {
         header.extra_field.resize(header.extra_field_length);
         if (!read(is, &header.extra_field[0], header.extra_field_length))
@@ -141,7 +104,7 @@ istream & zz::pkzip::operator >> (istream &is, central_file_header &header)
         string file_comment(header.file_comment_length, '\0');
         if (!is.read(&file_comment[0], header.file_comment_length))
             return is;
-        header.file_comment = use_utf8 ? utf_to_utf<char_type>(file_comment) : to_utf<char_type>(file_comment, header.charset);
+        header.file_comment = use_utf8 ? decode_utf8(file_comment) : decode(file_comment, header.charset);
     }
     return is;
 }
@@ -152,33 +115,24 @@ ostream & zz::pkzip::operator << (ostream &os, const central_file_header &header
     if ((general_purpose_bit_flag & general_purpose_bit_flags::use_utf8) == 0 && is_utf8(header.charset))
         general_purpose_bit_flag |= general_purpose_bit_flags::use_utf8;
     const auto use_utf8 = general_purpose_bit_flag & general_purpose_bit_flags::use_utf8;
-    const auto file_name = use_utf8 ? utf_to_utf<char>(header.file_name) : from_utf(header.file_name, header.charset);
+    const auto file_name = use_utf8 ? encode_utf8(header.file_name) : encode(header.file_name, header.charset);
     if (file_name.size() > numeric_limits<decltype(header.file_name_length)>::max())
         throw runtime_error("too long file name: " + file_name);
     if (header.extra_field.size() > numeric_limits<decltype(header.extra_field_length)>::max())
         throw runtime_error("too long extra field: " + file_name);
-    const auto file_comment = use_utf8 ? utf_to_utf<char>(header.file_comment) : from_utf(header.file_comment, header.charset);
+    const auto file_comment = use_utf8 ? encode_utf8(header.file_comment) : encode(header.file_comment, header.charset);
     if (file_comment.size() > numeric_limits<decltype(header.file_comment_length)>::max())
         throw runtime_error("too long file comment: " + file_comment);
 
-    write(os, header.signature);
-    write(os, header.version_made_by);
-    write(os, header.version_needed_to_extract);
-    write(os, general_purpose_bit_flag);
-    write(os, header.compression_method);
-    write(os, header.last_mod_file_time);
-    write(os, header.last_mod_file_date);
-    write(os, header.crc32);
-    write(os, header.compressed_size);
-    write(os, header.uncompressed_size);
-    write(os, static_cast<decltype(header.file_name_length)>(file_name.size()));
-    write(os, static_cast<decltype(header.extra_field_length)>(header.extra_field.size()));
-    write(os, static_cast<decltype(header.file_comment_length)>(file_comment.size()));
-    write(os, header.disk_number_start);
-    write(os, header.internal_file_attributes);
-    write(os, header.external_file_attributes);
-    write(os, header.relative_offset_of_local_header);
+    using layout_type = layout<central_file_header>;
+    uint8_t buffer[layout_type::size];
+    layout_type::encode(buffer, header);
+    layout_type::put<&central_file_header::general_purpose_bit_flag>(buffer, general_purpose_bit_flag);
+    layout_type::put<&central_file_header::file_name_length>(buffer, static_cast<uint16_t>(file_name.size()));
+    layout_type::put<&central_file_header::extra_field_length>(buffer, static_cast<uint16_t>(header.extra_field.size()));
+    layout_type::put<&central_file_header::file_comment_length>(buffer, static_cast<uint16_t>(file_comment.size()));
 
+    write(os, buffer, sizeof buffer);
     write(os, file_name.data(), file_name.size());
     write(os, header.extra_field.data(), header.extra_field.size());
     write(os, file_comment.data(), file_comment.size());
@@ -187,14 +141,8 @@ ostream & zz::pkzip::operator << (ostream &os, const central_file_header &header
 
 istream & zz::pkzip::operator >> (istream &is, end_of_central_directory_record &record)
 {
-    if (!read(is, record.signature) || !record ||
-        !read(is, record.number_of_this_disk) ||
-        !read(is, record.number_of_the_disk_with_the_start_of_the_central_directory) ||
-        !read(is, record.total_number_of_entries_in_the_central_directory_on_this_disk) ||
-        !read(is, record.total_number_of_entries_in_the_central_directory) ||
-        !read(is, record.size_of_the_central_directory) ||
-        !read(is, record.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number) ||
-        !read(is, record.zip_file_comment_length))
+    uint8_t buffer[layout<end_of_central_directory_record>::size];
+    if (!read(is, record, buffer))
         return is;
 
     if (record.zip_file_comment_length) {
@@ -210,15 +158,221 @@ ostream & zz::pkzip::operator << (ostream &os, const end_of_central_directory_re
     if (record.zip_file_comment.size() > numeric_limits<decltype(record.zip_file_comment_length)>::max())
         throw runtime_error("too long zip file comment: " + record.zip_file_comment);
 
-    write(os, record.signature);
-    write(os, record.number_of_this_disk);
-    write(os, record.number_of_the_disk_with_the_start_of_the_central_directory);
-    write(os, record.total_number_of_entries_in_the_central_directory_on_this_disk);
-    write(os, record.total_number_of_entries_in_the_central_directory);
-    write(os, record.size_of_the_central_directory);
-    write(os, record.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number);
-    write(os, static_cast<decltype(record.zip_file_comment_length)>(record.zip_file_comment.size()));
+    using layout_type = layout<end_of_central_directory_record>;
+    uint8_t buffer[layout_type::size];
+    layout_type::encode(buffer, record);
+    layout_type::put<&end_of_central_directory_record::zip_file_comment_length>(
+        buffer, static_cast<uint16_t>(record.zip_file_comment.size()));
 
+    write(os, buffer, sizeof buffer);
     write(os, record.zip_file_comment.data(), record.zip_file_comment.size());
     return os;
 }
+
+istream & zz::pkzip::operator >> (istream &is, zip64_end_of_central_directory_record &record)
+{
+    uint8_t buffer[layout<zip64_end_of_central_directory_record>::size];
+    read(is, record, buffer);
+    return is;
+}
+
+ostream & zz::pkzip::operator << (ostream &os, const zip64_end_of_central_directory_record &record)
+{
+    using layout_type = layout<zip64_end_of_central_directory_record>;
+    uint8_t buffer[layout_type::size];
+    layout_type::encode(buffer, record);
+
+    write(os, buffer, sizeof buffer);
+    return os;
+}
+
+istream & zz::pkzip::operator >> (istream &is, zip64_end_of_central_directory_locator &locator)
+{
+    uint8_t buffer[layout<zip64_end_of_central_directory_locator>::size];
+    read(is, locator, buffer);
+    return is;
+}
+
+ostream & zz::pkzip::operator << (ostream &os, const zip64_end_of_central_directory_locator &locator)
+{
+    using layout_type = layout<zip64_end_of_central_directory_locator>;
+    uint8_t buffer[layout_type::size];
+    layout_type::encode(buffer, locator);
+
+    write(os, buffer, sizeof buffer);
+    return os;
+}
+
+static constexpr auto zip64_mark = numeric_limits<uint32_t>::max();
+
+static auto find_zip64(const zz::pkzip::binary_type &extra_field)
+{
+    using zz::pkzip::detail::load_le;
+    for (size_t i = 0; i + 4 <= extra_field.size(); ) {
+        const auto id   = load_le<uint16_t>(&extra_field[i]);
+        const auto size = load_le<uint16_t>(&extra_field[i + 2]);
+        if (i + 4 + size > extra_field.size())
+            break;
+        if (id == zz::pkzip::header_id::zip64_extended_information)
+            return make_pair(i, static_cast<size_t>(size));
+        i += 4 + size;
+    }
+    return make_pair(extra_field.size(), size_t(0));
+}
+
+static uint64_t get_zip64(const zz::pkzip::binary_type &extra_field, size_t index)
+{
+    const auto [offset, size] = find_zip64(extra_field);
+    if (size < (index + 1) * sizeof(uint64_t))
+        throw runtime_error("invalid zip64 extended information");
+    return zz::pkzip::detail::load_le<uint64_t>(&extra_field[offset + 4 + index * sizeof(uint64_t)]);
+}
+
+static void set_zip64(zz::pkzip::binary_type &extra_field, initializer_list<uint64_t> values)
+{
+    using zz::pkzip::detail::store_le;
+    if (const auto [offset, size] = find_zip64(extra_field); offset < extra_field.size())
+        extra_field.erase(begin(extra_field) + offset, begin(extra_field) + offset + 4 + size);
+    if (values.size() == 0)
+        return;
+    const auto offset = extra_field.size();
+    extra_field.resize(offset + 4 + values.size() * sizeof(uint64_t));
+    store_le(&extra_field[offset], zz::pkzip::header_id::zip64_extended_information);
+    store_le(&extra_field[offset + 2], static_cast<uint16_t>(values.size() * sizeof(uint64_t)));
+    auto p = &extra_field[offset + 4];
+    for (const auto value : values) {
+        store_le(p, value);
+        p += sizeof value;
+    }
+}
+
+template <typename value_type>
+static inline auto narrow(uint64_t value) noexcept
+{
+    return static_cast<value_type>(min<uint64_t>(value, numeric_limits<value_type>::max()));
+}
+
+void zz::pkzip::set_sizes(local_file_header &header, uint64_t compressed_size, uint64_t uncompressed_size)
+{
+    header.compressed_size   = narrow<uint32_t>(compressed_size);
+    header.uncompressed_size = narrow<uint32_t>(uncompressed_size);
+    // the local header carries both sizes or neither
+    if (header.compressed_size == zip64_mark || header.uncompressed_size == zip64_mark) {
+        header.compressed_size = header.uncompressed_size = zip64_mark;
+        header.version_needed_to_extract = max(header.version_needed_to_extract, version_needed_to_extract::zip64);
+        set_zip64(header.extra_field, { uncompressed_size, compressed_size });
+    } else {
+        set_zip64(header.extra_field, {});
+    }
+}
+
+void zz::pkzip::set_sizes(central_file_header &header, uint64_t compressed_size, uint64_t uncompressed_size,
+                          uint64_t relative_offset_of_local_header)
+{
+    header.compressed_size                 = narrow<uint32_t>(compressed_size);
+    header.uncompressed_size               = narrow<uint32_t>(uncompressed_size);
+    header.relative_offset_of_local_header = narrow<uint32_t>(relative_offset_of_local_header);
+    uint64_t values[3];
+    size_t count = 0;
+    if (header.uncompressed_size == zip64_mark)
+        values[count++] = uncompressed_size;
+    if (header.compressed_size == zip64_mark)
+        values[count++] = compressed_size;
+    if (header.relative_offset_of_local_header == zip64_mark)
+        values[count++] = relative_offset_of_local_header;
+    switch (count) {
+    case 0: set_zip64(header.extra_field, {}); return;
+    case 1: set_zip64(header.extra_field, { values[0] }); break;
+    case 2: set_zip64(header.extra_field, { values[0], values[1] }); break;
+    case 3: set_zip64(header.extra_field, { values[0], values[1], values[2] }); break;
+    }
+    header.version_needed_to_extract = max(header.version_needed_to_extract, version_needed_to_extract::zip64);
+    if ((header.version_made_by & 0xFF) < version_needed_to_extract::zip64)
+        header.version_made_by = (header.version_made_by & 0xFF00) | version_needed_to_extract::zip64;
+}
+
+zz::pkzip::central_file_header zz::pkzip::make_central_file_header(const local_file_header &header,
+                                                                   uint64_t compressed_size, uint64_t uncompressed_size,
+                                                                   uint64_t relative_offset_of_local_header,
+                                                                   uint32_t external_file_attributes)
+{
+    central_file_header record(header.charset);
+    record.version_made_by           = header.version_needed_to_extract | version_made_by::msdos;
+    record.version_needed_to_extract = header.version_needed_to_extract;
+    record.general_purpose_bit_flag  = header.general_purpose_bit_flag;
+    record.compression_method        = header.compression_method;
+    record.last_mod_file_time        = header.last_mod_file_time;
+    record.last_mod_file_date        = header.last_mod_file_date;
+    record.crc32                     = header.crc32;
+    record.external_file_attributes  = external_file_attributes;
+    record.file_name                 = header.file_name;
+    record.extra_field               = header.extra_field;
+    set_sizes(record, compressed_size, uncompressed_size, relative_offset_of_local_header);
+    return record;
+}
+
+uint64_t zz::pkzip::get_compressed_size(const local_file_header &header)
+{
+    if (header.compressed_size != zip64_mark)
+        return header.compressed_size;
+    return get_zip64(header.extra_field, header.uncompressed_size == zip64_mark);
+}
+
+uint64_t zz::pkzip::get_uncompressed_size(const local_file_header &header)
+{
+    if (header.uncompressed_size != zip64_mark)
+        return header.uncompressed_size;
+    return get_zip64(header.extra_field, 0);
+}
+
+uint64_t zz::pkzip::get_compressed_size(const central_file_header &header)
+{
+    if (header.compressed_size != zip64_mark)
+        return header.compressed_size;
+    return get_zip64(header.extra_field, header.uncompressed_size == zip64_mark);
+}
+
+uint64_t zz::pkzip::get_uncompressed_size(const central_file_header &header)
+{
+    if (header.uncompressed_size != zip64_mark)
+        return header.uncompressed_size;
+    return get_zip64(header.extra_field, 0);
+}
+
+uint64_t zz::pkzip::get_relative_offset_of_local_header(const central_file_header &header)
+{
+    if (header.relative_offset_of_local_header != zip64_mark)
+        return header.relative_offset_of_local_header;
+    return get_zip64(header.extra_field, (header.uncompressed_size == zip64_mark) + (header.compressed_size == zip64_mark));
+}
+
+ostream & zz::pkzip::write_end_of_central_directory(ostream &os, uint64_t number_of_entries,
+                                                    uint64_t offset_of_central_directory,
+                                                    uint64_t size_of_central_directory)
+{
+    end_of_central_directory_record footer;
+    footer.total_number_of_entries_in_the_central_directory_on_this_disk
+        = narrow<decltype(footer.total_number_of_entries_in_the_central_directory_on_this_disk)>(number_of_entries);
+    footer.total_number_of_entries_in_the_central_directory
+        = narrow<decltype(footer.total_number_of_entries_in_the_central_directory)>(number_of_entries);
+    footer.size_of_the_central_directory
+        = narrow<decltype(footer.size_of_the_central_directory)>(size_of_central_directory);
+    footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number
+        = narrow<decltype(footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number)>(offset_of_central_directory);
+
+    if (footer.total_number_of_entries_in_the_central_directory == numeric_limits<uint16_t>::max() ||
+        footer.size_of_the_central_directory == zip64_mark ||
+        footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number == zip64_mark) {
+        zip64_end_of_central_directory_record record;
+        record.total_number_of_entries_in_the_central_directory_on_this_disk = number_of_entries;
+        record.total_number_of_entries_in_the_central_directory              = number_of_entries;
+        record.size_of_the_central_directory                                 = size_of_central_directory;
+        record.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number
+            = offset_of_central_directory;
+        zip64_end_of_central_directory_locator locator;
+        locator.relative_offset_of_the_zip64_end_of_central_directory_record
+            = offset_of_central_directory + size_of_central_directory;
+        os << record << locator;
+    }
+    return os << footer;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <istream>
 #include <ostream>
 
@@ -15,4 +16,32 @@ namespace zz::pkzip
 
     std::istream & operator >> (std::istream &, end_of_central_directory_record &);
     std::ostream & operator << (std::ostream &, const end_of_central_directory_record &);
+
+    std::istream & operator >> (std::istream &, zip64_end_of_central_directory_record &);
+    std::ostream & operator << (std::ostream &, const zip64_end_of_central_directory_record &);
+
+    std::istream & operator >> (std::istream &, zip64_end_of_central_directory_locator &);
+    std::ostream & operator << (std::ostream &, const zip64_end_of_central_directory_locator &);
+
+    // sizes and offsets that overflow 32 bits are moved to the Zip64 extended information extra field
+    void set_sizes(local_file_header &, uint64_t compressed_size, uint64_t uncompressed_size);
+    void set_sizes(central_file_header &, uint64_t compressed_size, uint64_t uncompressed_size,
+                   uint64_t relative_offset_of_local_header);
+
+    // the central directory record of an entry written with the given local header
+    central_file_header make_central_file_header(const local_file_header &,
+                                                 uint64_t compressed_size, uint64_t uncompressed_size,
+                                                 uint64_t relative_offset_of_local_header,
+                                                 uint32_t external_file_attributes);
+
+    uint64_t get_compressed_size(const local_file_header &);
+    uint64_t get_uncompressed_size(const local_file_header &);
+    uint64_t get_compressed_size(const central_file_header &);
+    uint64_t get_uncompressed_size(const central_file_header &);
+    uint64_t get_relative_offset_of_local_header(const central_file_header &);
+
+    // writes the Zip64 record and locator first when any of the values does not fit
+    std::ostream & write_end_of_central_directory(std::ostream &, uint64_t number_of_entries,
+                                                  uint64_t offset_of_central_directory,
+                                                  uint64_t size_of_central_directory);
 }
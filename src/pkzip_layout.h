@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "pkzip.h"
+
+namespace zz::pkzip
+{
+    namespace detail
+    {
+        template <typename> struct member_traits;
+        template <typename class_type, typename value_type>
+        struct member_traits<value_type class_type::*>
+        {
+            using record_type = class_type;
+            using field_type  = value_type;
+        };
+        template <auto field>
+        using field_type_t = typename member_traits<decltype(field)>::field_type;
+
+        template <auto lhs, auto rhs>
+        constexpr bool same_field() noexcept
+        {
+            if constexpr (std::is_same_v<decltype(lhs), decltype(rhs)>)
+                return lhs == rhs;
+            else
+                return false;
+        }
+
+        template <typename value_type>
+        constexpr void store_le(uint8_t *p, value_type value) noexcept
+        {
+            for (size_t i = 0; i < sizeof value; i++)
+                p[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+
+        template <typename value_type>
+        constexpr value_type load_le(const uint8_t *p) noexcept
+        {
+            value_type value = 0;
+            for (size_t i = 0; i < sizeof value; i++)
+                value |= static_cast<value_type>(static_cast<value_type>(p[i]) << (8 * i));
+            return value;
+        }
+    }
+
+    /// Fixed-size part of a record, packed little-endian in declaration order.
+    template <auto... fields>
+    struct basic_layout
+    {
+        static constexpr size_t size = (sizeof(detail::field_type_t<fields>) + ...);
+
+        template <auto field>
+        static constexpr size_t offset_of = [] {
+            size_t offset = 0;
+            bool found = false;
+            ((found = found || detail::same_field<fields, field>(),
+              offset += found ? 0 : sizeof(detail::field_type_t<fields>)), ...);
+            return offset;
+        }();
+
+        template <typename record_type>
+        static void encode(uint8_t *p, const record_type &record) noexcept
+        {
+            ((detail::store_le(p, record.*fields), p += sizeof(detail::field_type_t<fields>)), ...);
+        }
+
+        template <typename record_type>
+        static void decode(const uint8_t *p, record_type &record) noexcept
+        {
+            ((record.*fields = detail::load_le<detail::field_type_t<fields>>(p),
+              p += sizeof(detail::field_type_t<fields>)), ...);
+        }
+
+        template <auto field>
+        static void put(uint8_t *p, detail::field_type_t<field> value) noexcept
+        {
+            detail::store_le(p + offset_of<field>, value);
+        }
+    };
+
+    template <typename record_type> struct layout;
+
+    template <>
+    struct layout<local_file_header> : basic_layout<
+        &local_file_header::signature,
+        &local_file_header::version_needed_to_extract,
+        &local_file_header::general_purpose_bit_flag,
+        &local_file_header::compression_method,
+        &local_file_header::last_mod_file_time,
+        &local_file_header::last_mod_file_date,
+        &local_file_header::crc32,
+        &local_file_header::compressed_size,
+        &local_file_header::uncompressed_size,
+        &local_file_header::file_name_length,
+        &local_file_header::extra_field_length
+        >
+    {
+    };
+    static_assert(layout<local_file_header>::size == 30);
+
+    template <>
+    struct layout<central_file_header> : basic_layout<
+        &central_file_header::signature,
+        &central_file_header::version_made_by,
+        &central_file_header::version_needed_to_extract,
+        &central_file_header::general_purpose_bit_flag,
+        &central_file_header::compression_method,
+        &central_file_header::last_mod_file_time,
+        &central_file_header::last_mod_file_date,
+        &central_file_header::crc32,
+        &central_file_header::compressed_size,
+        &central_file_header::uncompressed_size,
+        &central_file_header::file_name_length,
+        &central_file_header::extra_field_length,
+        &central_file_header::file_comment_length,
+        &central_file_header::disk_number_start,
+        &central_file_header::internal_file_attributes,
+        &central_file_header::external_file_attributes,
+        &central_file_header::relative_offset_of_local_header
+        >
+    {
+    };
+    static_assert(layout<central_file_header>::size == 46);
+
+    template <>
+    struct layout<end_of_central_directory_record> : basic_layout<
+        &end_of_central_directory_record::signature,
+        &end_of_central_directory_record::number_of_this_disk,
+        &end_of_central_directory_record::number_of_the_disk_with_the_start_of_the_central_directory,
+        &end_of_central_directory_record::total_number_of_entries_in_the_central_directory_on_this_disk,
+        &end_of_central_directory_record::total_number_of_entries_in_the_central_directory,
+        &end_of_central_directory_record::size_of_the_central_directory,
+        &end_of_central_directory_record::offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number,
+        &end_of_central_directory_record::zip_file_comment_length
+        >
+    {
+    };
+    static_assert(layout<end_of_central_directory_record>::size == 22);
+
+    template <>
+    struct layout<zip64_end_of_central_directory_record> : basic_layout<
+        &zip64_end_of_central_directory_record::signature,
+        &zip64_end_of_central_directory_record::size_of_zip64_end_of_central_directory_record,
+        &zip64_end_of_central_directory_record::version_made_by,
+        &zip64_end_of_central_directory_record::version_needed_to_extract,
+        &zip64_end_of_central_directory_record::number_of_this_disk,
+        &zip64_end_of_central_directory_record::number_of_the_disk_with_the_start_of_the_central_directory,
+        &zip64_end_of_central_directory_record::total_number_of_entries_in_the_central_directory_on_this_disk,
+        &zip64_end_of_central_directory_record::total_number_of_entries_in_the_central_directory,
+        &zip64_end_of_central_directory_record::size_of_the_central_directory,
+        &zip64_end_of_central_directory_record::offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number
+        >
+    {
+    };
+    static_assert(layout<zip64_end_of_central_directory_record>::size == 56);
+
+    template <>
+    struct layout<zip64_end_of_central_directory_locator> : basic_layout<
+        &zip64_end_of_central_directory_locator::signature,
+        &zip64_end_of_central_directory_locator::number_of_the_disk_with_the_start_of_the_zip64_end_of_central_directory,
+        &zip64_end_of_central_directory_locator::relative_offset_of_the_zip64_end_of_central_directory_record,
+        &zip64_end_of_central_directory_locator::total_number_of_disks
+        >
+    {
+    };
+    static_assert(layout<zip64_end_of_central_directory_locator>::size == 20);
+}
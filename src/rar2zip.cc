@@ -1,31 +1,37 @@
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable: 4244 4245)
-#endif
-#include <boost/crc.hpp>
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
-
+#include "crc32.h"
 #include "dll.h"
+#include "exclude.h"
+#include "file.h"
+#include "natural_sort.h"
 #include "path_ops.h"
 #include "pkzip_io.h"
+#include "rar_reader.h"
 #include "strnatcmp.h"
+#include "zip_writer.h"
 
 #include "rar2zip.h"
 
 using namespace zz;
 using namespace std;
 
-using crc32_t = boost::crc_32_type;
-
 #define ERAR_SUCCESS             0
 #define ERAR_END_ARCHIVE        10
 #define ERAR_NO_MEMORY          11
@@ -66,6 +72,9 @@ using crc32_t = boost::crc_32_type;
 #define RHDF_SOLID       0x10
 #define RHDF_DIRECTORY   0x20
 
+#define ROADF_VOLUME     0x0001
+#define ROADF_SOLID      0x0008
+
 #ifndef _WIN32
 #define CALLBACK
 #define PASCAL
@@ -175,155 +184,474 @@ public:
     void   (PASCAL *RARSetCallback)(HANDLE, UNRARCALLBACK, intptr_t) = nullptr;
 };
 
-bool zz::rar_exists()
+// Takes the data unrar hands out in small chunks into a few large buffers, which a thread of its own writes
+// to their place in the zip, so that decompression goes on while the previous data is written. The buffers are
+// all the memory it uses; once they are all full, the producer waits.
+class background_writer
 {
-    libunrar unrar;
-    return !!unrar;
-}
+    background_writer(const background_writer &) = delete;
+    background_writer & operator = (const background_writer &) = delete;
+public:
+    background_writer(zip_writer &zip, size_t buffer_size, size_t buffers)
+        : _zip(zip)
+        , _buffers(buffers, vector<char>(buffer_size))
+    {
+        for (size_t i = 0; i < buffers; i++)
+            _free.push_back(i);
+        _thread = thread([this] { run(); });
+    }
+    ~background_writer() noexcept
+    {
+        {
+            lock_guard lock(_guard);
+            _stop = true;
+        }
+        _wake.notify_all();
+        _thread.join();
+    }
 
-void zz::rar2zip(const fs::path &path, const options &opts)
-{
-    libunrar unrar;
-    if (!unrar)
-        throw runtime_error("libunrar not found");
+    /// Starts an entry whose data goes at the given offset of the zip and takes size bytes.
+    /// Only to be called between entries, once flushed.
+    void start(uint64_t offset, uint64_t size) noexcept
+    {
+        _offset = offset;
+        _end    = offset + size;
+        _crc32  = crc32_t();
+    }
 
-    const auto filename = path.filename();
+    void write(const char *data, size_t size)
+    {
+        if (size > _end - _offset - _used)
+            throw runtime_error("size changed while extracting");
+        while (size) {
+            if (_current == none) {
+                unique_lock lock(_guard);
+                _wake.wait(lock, [this] { return !_free.empty() || _error; });
+                if (_error)
+                    rethrow_exception(_error);
+                _current = _free.back();
+                _free.pop_back();
+            }
+            auto &buffer = _buffers[_current];
+            const auto n = min(size, buffer.size() - _used);
+            memcpy(buffer.data() + _used, data, n);
+            _used += n;
+            data  += n;
+            size  -= n;
+            if (_used == buffer.size())
+                submit();
+        }
+    }
+
+    /// Waits until everything given so far has been written; returns whether that is the whole entry.
+    bool flush()
+    {
+        if (_used)
+            submit();
+        unique_lock lock(_guard);
+        _wake.wait(lock, [this] { return (_queue.empty() && !_busy) || _error; });
+        if (_error)
+            rethrow_exception(_error);
+        return _offset == _end;
+    }
+
+    /// The CRC of the entry, computed along with the writes; once flushed.
+    uint32_t crc32() const noexcept
+    {
+        return _crc32();
+    }
+private:
+    static constexpr size_t none = SIZE_MAX;
 
-    unique_handle<HANDLE, decltype(unrar.RARCloseArchive)> hArchive(unrar.RARCloseArchive);
+    struct chunk
     {
-        RAROpenArchiveDataEx rarOpenData = {};
+        size_t   buffer;
+        size_t   size;
+        uint64_t offset;
+    };
+
+    void submit()
+    {
+        {
+            lock_guard lock(_guard);
+            _queue.push_back({ _current, _used, _offset });
+        }
+        _wake.notify_all();
+        _offset += _used;
+        _current = none;
+        _used    = 0;
+    }
+
+    void run()
+    {
+        unique_lock lock(_guard);
+        for (;;) {
+            _wake.wait(lock, [this] { return !_queue.empty() || _stop; });
+            if (_stop)
+                return;
+            const auto [i, n, offset] = _queue.front();
+            _queue.pop_front();
+            const auto failed = _error != nullptr;
+            _busy = true;
+            lock.unlock();
+            try {
+                if (!failed) {
+                    _crc32.process_bytes(_buffers[i].data(), n);
+                    _zip.write_at(_buffers[i].data(), n, offset);
+                }
+            } catch (...) {
+                lock.lock();
+                if (!_error)
+                    _error = current_exception();
+                lock.unlock();
+            }
+            lock.lock();
+            _busy = false;
+            _free.push_back(i);
+            _wake.notify_all();
+        }
+    }
+
+    zip_writer                    &_zip;
+    vector<vector<char>>           _buffers;
+    vector<size_t>                 _free;
+    deque<chunk>                   _queue;     // the buffers to write
+    size_t                         _current = none;
+    size_t                         _used    = 0;
+    uint64_t                       _offset  = 0;   // where the current buffer goes
+    uint64_t                       _end     = 0;   // of the entry
+    crc32_t                        _crc32;
+    bool                           _busy    = false;
+    bool                           _stop    = false;
+    exception_ptr                  _error;
+    mutex                          _guard;
+    condition_variable             _wake;
+    thread                         _thread;
+};
+
+// what the unrar callback writes to
+struct extraction
+{
+    background_writer  &writer;
+    const atomic<bool> &stop;       // another thread failed
+    exception_ptr       error;
+};
+
+// an entry, laid out in the zip before it is extracted
+struct rar_entry
+{
+    pkzip::local_file_header header;
+    size_t                   index;         // among the headers of the archive
+    uint64_t                 size;
+    uint64_t                 offset = 0;    // of its data in the zip
+    bool                     has_crc32;     // whether the archive has its CRC, or a BLAKE2 hash instead
+    const rar_record        *stored = nullptr;  // located by rar_reader, to be copied as is
+};
+
+// the buffers of each background writer, each of --buffer-size bytes
+static constexpr size_t write_buffers = 4;
+
+static HANDLE open_archive(const libunrar &unrar, const fs::path &path, uint32_t mode, uint32_t *flags = nullptr)
+{
+    RAROpenArchiveDataEx rarOpenData = {};
 #ifdef _UNICODE
-        rarOpenData.ArcNameW = const_cast<wchar_t *>(path.c_str());
+    rarOpenData.ArcNameW = const_cast<wchar_t *>(path.c_str());
 #else
-        rarOpenData.ArcName  = const_cast<char *>(path.c_str());
+    rarOpenData.ArcName  = const_cast<char *>(path.c_str());
 #endif
-        rarOpenData.OpenMode = RAR_OM_EXTRACT;
-        hArchive = unrar.RAROpenArchiveEx(&rarOpenData);
-        if (rarOpenData.OpenResult != ERAR_SUCCESS)
-            throw runtime_error("failed to open: " + filename);
+    rarOpenData.OpenMode = mode;
+    const auto hArchive = unrar.RAROpenArchiveEx(&rarOpenData);
+    if (rarOpenData.OpenResult != ERAR_SUCCESS) {
+        if (hArchive)
+            unrar.RARCloseArchive(hArchive);
+        throw runtime_error("failed to open: " + path.filename());
     }
+    if (flags)
+        *flags = rarOpenData.Flags;
+    return hArchive;
+}
 
-    const auto zip_path = path.parent_path() / path.filename().replace_extension(".zip");
-    io::ofstream zip;
-    zip.exceptions(ios::failbit | ios::badbit);
-    zip.open(zip_path, ios::binary);
-
-    vector<pkzip::central_file_header> records;
-    for (;;) {
-        RARHeaderDataEx rarHeaderData = {};
-        if (unrar.RARReadHeaderEx(hArchive, &rarHeaderData) != ERAR_SUCCESS)
-            break;
-        if (rarHeaderData.Flags & RHDF_ENCRYPTED)
-            throw runtime_error("encryption not supported: " + filename);
-        if (rarHeaderData.Flags & RHDF_DIRECTORY)
-            continue;
-        if (rarHeaderData.UnpSizeHigh != 0)
-            throw runtime_error("large file not supported: " + filename);
-
-        pkzip::local_file_header header(opts.charsets.second);
-        header.general_purpose_bit_flag = strnatcasecmp(header.charset, "utf8"s) == 0
-                                        ? pkzip::general_purpose_bit_flags::use_utf8
-                                        : 0;
-        header.last_mod_file_time       = static_cast<uint16_t>(rarHeaderData.FileTime >>  0 & 0xFFFF);
-        header.last_mod_file_date       = static_cast<uint16_t>(rarHeaderData.FileTime >> 16 & 0xFFFF);
-        header.compressed_size          = rarHeaderData.UnpSize;
-        header.uncompressed_size        = rarHeaderData.UnpSize;
+static pkzip::local_file_header make_header(pkzip::string_type file_name, uint32_t dos_date_time, const options &opts)
+{
+    pkzip::local_file_header header(opts.charsets.second);
+    header.general_purpose_bit_flag = strnatcasecmp(header.charset, "utf8"s) == 0
+                                    ? pkzip::general_purpose_bit_flags::use_utf8
+                                    : 0;
+    header.last_mod_file_time       = static_cast<uint16_t>(dos_date_time >>  0 & 0xFFFF);
+    header.last_mod_file_date       = static_cast<uint16_t>(dos_date_time >> 16 & 0xFFFF);
+    header.file_name                = move(file_name);
+    replace(begin(header.file_name), end(header.file_name), '\\', '/');
+    return header;
+}
+
+static pkzip::local_file_header make_header(const RARHeaderDataEx &rarHeaderData, const options &opts)
+{
 #ifdef _UNICODE
-        header.file_name                = rarHeaderData.FileNameW;
+    return make_header(rarHeaderData.FileNameW, rarHeaderData.FileTime, opts);
 #else
-        header.file_name                = rarHeaderData.FileName;
+    return make_header(rarHeaderData.FileName, rarHeaderData.FileTime, opts);
 #endif
-        replace(begin(header.file_name), end(header.file_name), '\\', '/');
-        if (any_of(begin(opts.excludes), end(opts.excludes), [&header](basic_string_view<pkzip::char_type> x)
-                   { return x.starts_with('*') ? header.file_name.ends_with(x.substr(1)) : header.file_name == x; })) {
-            unrar.RARProcessFileW(hArchive, RAR_SKIP, nullptr, nullptr);
-            continue;
-        }
+}
 
-        const streamoff offset = zip.tellp();
-        if (offset > numeric_limits<decltype(pkzip::central_file_header::relative_offset_of_local_header)>::max())
-            throw runtime_error("large file not supported: " + filename);
-        zip << header;
+// Extracts the entries laid out in the zip to their place in it, on as many threads as given, each with an archive
+// handle and a background writer of its own. The entries are taken in archive order, so each handle only moves
+// forward, skipping the others. Stored entries located by the reader are copied as they are, without unrar.
+// The CRCs the archive does not have are filled in at the end; the others are checked wherever the data goes
+// through this process, and a mismatch is handled as opts.crc_policy says.
+static void extract(const libunrar &unrar, const fs::path &path, const options &opts, zip_writer &zip,
+                    const vector<rar_entry> &entries, const rar_reader *reader, size_t jobs)
+{
+    auto &out = *opts.out;
+    const auto filename = path.filename();
 
-        struct context_t
-        {
-            context_t(ostream &s)
-                : stream(s)
-            {
-            }
-            void write(const void *buffer, size_t count)
-            {
-                stream.write(static_cast<const char *>(buffer), count);
-                crc32.process_bytes(buffer, count);
+    vector<size_t> order(entries.size());
+    iota(begin(order), end(order), size_t(0));
+    sort(begin(order), end(order), [&entries](size_t lhs, size_t rhs) { return entries[lhs].index < entries[rhs].index; });
+
+    optional<file> source;
+    if (reader)
+        source.emplace(path, file::read_only);
+
+    vector<uint32_t> crcs(entries.size());
+    atomic<size_t> next = 0;
+    atomic<bool> stop = false;
+    size_t done = 0;
+    mutex guard;
+    exception_ptr error;
+    vector<size_t> skipped;
+    const auto work = [&] {
+        try {
+            // opened on the first entry to decompress
+            unique_handle<HANDLE, decltype(unrar.RARCloseArchive)> hArchive(unrar.RARCloseArchive);
+            optional<background_writer> writer;
+            size_t index = 0;
+            for (size_t k; !stop && (k = next++) < order.size(); ) {
+                const auto i = order[k];
+                const auto &entry = entries[i];
+                auto checked = true;
+                if (entry.stored) {
+                    // moved by the kernel where it can, without being read here, so its CRC is taken as it is;
+                    // written from the mapping otherwise, each piece checked while it is still in the cache.
+                    // An entry without a CRC has to be read for one
+                    const auto payload = reader->data(*entry.stored);
+                    if (entry.has_crc32 &&
+                        zip.copy_range(*source, entry.stored->data_offset, payload.size(), entry.offset) != copy_method::none) {
+                        checked = false;
+                    } else {
+                        crc32_t crc32;
+                        for (size_t done = 0; done < payload.size(); ) {
+                            const auto n = min(payload.size() - done, opts.buffer_size);
+                            crc32.process_bytes(payload.data() + done, n);
+                            zip.write_at(payload.data() + done, n, entry.offset + done);
+                            done += n;
+                        }
+                        crcs[i] = crc32();
+                    }
+                } else {
+                    if (!hArchive) {
+                        hArchive = open_archive(unrar, path, RAR_OM_EXTRACT);
+                        writer.emplace(zip, opts.buffer_size, write_buffers);
+                    }
+                    RARHeaderDataEx rarHeaderData;
+                    for (;; index++) {
+                        rarHeaderData = {};
+                        if (unrar.RARReadHeaderEx(hArchive, &rarHeaderData) != ERAR_SUCCESS)
+                            throw runtime_error("failed to read: " + filename);
+                        if (index == entry.index)
+                            break;
+                        if (unrar.RARProcessFileW(hArchive, RAR_SKIP, nullptr, nullptr) != ERAR_SUCCESS)
+                            throw runtime_error("failed to read: " + filename);
+                    }
+                    index++;
+                    if (make_header(rarHeaderData, opts).file_name != entry.header.file_name)
+                        throw runtime_error("archive changed while converting: " + filename);
+
+                    writer->start(entry.offset, entry.size);
+                    extraction context{ *writer, stop };
+                    unrar.RARSetCallback(hArchive, [](const uint32_t msg, intptr_t user_data, intptr_t p1, intptr_t p2) {
+                        switch (msg) {
+                        case UCM_PROCESSDATA: {
+                            // nothing may be thrown across unrar; an error stops the extraction instead
+                            auto &context = *reinterpret_cast<extraction *>(user_data);
+                            if (context.stop)
+                                return -1;
+                            try {
+                                context.writer.write(reinterpret_cast<const char *>(p1), static_cast<size_t>(p2));
+                            } catch (...) {
+                                context.error = current_exception();
+                                return -1;
+                            }
+                            return 1;
+                        }
+                        }
+                        return -1;
+                    }, reinterpret_cast<intptr_t>(&context));
+                    const auto result = unrar.RARProcessFileW(hArchive, RAR_TEST, nullptr, nullptr);
+                    if (context.error)
+                        rethrow_exception(context.error);
+                    if (stop)
+                        return;
+                    if (!writer->flush())
+                        throw runtime_error("failed to read: " + filename);
+                    crcs[i] = writer->crc32();
+                    // unrar reports a CRC mismatch as bad data; whole data that does not match its CRC-32 is left
+                    // to the policy below, anything else is an error
+                    if (result != ERAR_SUCCESS &&
+                        !(result == ERAR_BAD_DATA && entry.has_crc32 && crcs[i] != entry.header.crc32))
+                        throw runtime_error("failed to read: " + filename);
+                }
+                const auto mismatch = checked && entry.has_crc32 && crcs[i] != entry.header.crc32;
+                if (mismatch && opts.crc_policy == crc_policy::fatal)
+                    throw runtime_error("crc32 mismatch: " + fs::path(entry.header.file_name));
+
+                lock_guard lock(guard);
+                if (mismatch) {
+                    if (opts.crc_policy == crc_policy::skip)
+                        skipped.push_back(i);
+                    if (!opts.quiet)
+                        out << endl;
+                    out << (opts.crc_policy == crc_policy::skip ? "   crc32 mismatch, skipped: " : "   crc32 mismatch: ")
+                         + fs::path(entry.header.file_name) << endl;
+                }
+                done++;
+                if (!opts.quiet)
+                    out << "\r   " << dec << setw(3) << setfill('0') << done << " entries written" << flush;
             }
-            ostream &stream;
-            crc32_t  crc32;
-        } context(zip);
-        unrar.RARSetCallback(hArchive, [](const uint32_t msg, intptr_t user_data, intptr_t p1, intptr_t p2) {
-            switch (msg) {
-            case UCM_PROCESSDATA:
-                reinterpret_cast<context_t *>(user_data)
-                    ->write(reinterpret_cast<const void *>(p1), static_cast<size_t>(p2));
-                return 1;
+        } catch (...) {
+            lock_guard lock(guard);
+            if (!error)
+                error = current_exception();
+            stop = true;
+        }
+    };
+    vector<thread> workers;
+    for (size_t i = 1; i < jobs; i++)
+        workers.emplace_back(work);
+    work();
+    for (auto &worker : workers)
+        worker.join();
+    if (error)
+        rethrow_exception(error);
+
+    for (size_t i = 0; i < entries.size(); i++)
+        if (!entries[i].has_crc32)
+            zip.set_crc32(i, crcs[i]);
+    // the data of a skipped entry stays where it was laid out, but nothing refers to it any more
+    sort(begin(skipped), end(skipped), greater<>());
+    for (const auto i : skipped)
+        zip.discard_entry(i);
+}
+
+void zz::rar2zip(const fs::path &path, const options &opts)
+{
+    auto &out = *opts.out;
+    libunrar unrar;
+
+    const auto filename = path.filename();
+    const exclude_matcher excluded(opts.excludes);
+
+    // the headers are read by the native reader, which locates the stored entries to copy them as they are;
+    // unrar, when there, lists the entries and decompresses the others, and reads what the native reader cannot
+    optional<rar_reader> reader;
+    try {
+        reader.emplace(path, opts.charsets.first);
+    } catch (const exception &) {
+        if (!unrar)
+            throw;
+    }
+
+    // the headers are listed first, so that the entries can be laid out in natural order and extracted in one pass
+    vector<rar_entry> entries;
+    auto independent = false;
+    if (unrar) {
+        unique_handle<HANDLE, decltype(unrar.RARCloseArchive)> hArchive(unrar.RARCloseArchive);
+        uint32_t flags = 0;
+        hArchive = open_archive(unrar, path, RAR_OM_LIST, &flags);
+        independent = !(flags & (ROADF_SOLID | ROADF_VOLUME));
+
+        for (size_t index = 0; ; index++) {
+            RARHeaderDataEx rarHeaderData = {};
+            if (unrar.RARReadHeaderEx(hArchive, &rarHeaderData) != ERAR_SUCCESS)
+                break;
+            if (rarHeaderData.Flags & RHDF_ENCRYPTED)
+                throw runtime_error("encryption not supported: " + filename);
+            if (rarHeaderData.Flags & RHDF_SOLID)
+                independent = false;
+            if (unrar.RARProcessFileW(hArchive, RAR_SKIP, nullptr, nullptr) != ERAR_SUCCESS)
+                throw runtime_error("failed to read: " + filename);
+            if (rarHeaderData.Flags & RHDF_DIRECTORY)
+                continue;
+
+            auto header = make_header(rarHeaderData, opts);
+            if (excluded(header.file_name))
+                continue;
+            // the CRC the archive has goes in the header, and is checked against the data as it is written;
+            // with a BLAKE2 hash instead, it is filled in once the entry has been extracted
+            const auto has_crc32 = rarHeaderData.HashType == RAR_HASH_CRC32;
+            header.crc32 = has_crc32 ? rarHeaderData.FileCRC : 0;
+            const auto size = static_cast<uint64_t>(rarHeaderData.UnpSizeHigh) << 32 | rarHeaderData.UnpSize;
+
+            // the native reader's entry is only used if it describes the same one, with a CRC to check the copy
+            // against; unrar checks BLAKE2 hashes, which the copy cannot
+            const rar_record *stored = nullptr;
+            if (reader && has_crc32 && index < reader->records().size()) {
+                const auto &record = reader->records()[index];
+                if (record.copyable() && record.size == size && record.dos_date_time == rarHeaderData.FileTime &&
+                    record.has_crc32 && record.crc32 == header.crc32)
+                    stored = &record;
             }
-            return -1;
-        }, reinterpret_cast<intptr_t>(&context));
-        if (unrar.RARProcessFileW(hArchive, RAR_TEST, nullptr, nullptr) != ERAR_SUCCESS)
-            throw runtime_error("failed to read: " + filename);
-
-        header.crc32 = context.crc32();
-        const auto next_offset = zip.tellp();
-        zip.seekp(offset) << header;
-        zip.seekp(next_offset);
-
-        pkzip::central_file_header record(opts.charsets.second);
-        record.version_made_by                 = header.version_needed_to_extract | pkzip::version_made_by::msdos;
-        record.version_needed_to_extract       = header.version_needed_to_extract;
-        record.general_purpose_bit_flag        = header.general_purpose_bit_flag;
-        record.last_mod_file_time              = header.last_mod_file_time;
-        record.last_mod_file_date              = header.last_mod_file_date;
-        record.crc32                           = header.crc32;
-        record.compressed_size                 = header.compressed_size;
-        record.uncompressed_size               = header.uncompressed_size;
-        record.relative_offset_of_local_header = static_cast<decltype(record.relative_offset_of_local_header)>(offset);
-        record.file_name                       = header.file_name;
-        records.push_back(record);
-        if (records.size() > numeric_limits<decltype(pkzip::end_of_central_directory_record::total_number_of_entries_in_the_central_directory)>::max())
-            throw runtime_error("too many entries: " + filename);
-
-        if (!opts.quiet)
-            cout << "\r   " << dec << setw(3) << setfill('0') << records.size() << " entries written";
+            entries.push_back({ move(header), index, size, 0, has_crc32, stored });
+        }
+    } else {
+        // the entries of the other volumes are out of reach
+        if (reader->volume())
+            throw runtime_error("libunrar not found");
+        const auto &records = reader->records();
+        for (size_t index = 0; index < records.size(); index++) {
+            const auto &record = records[index];
+            if (record.encrypted)
+                throw runtime_error("encryption not supported: " + filename);
+            if (record.directory)
+                continue;
+
+            auto header = make_header(record.name, record.dos_date_time, opts);
+            if (excluded(header.file_name))
+                continue;
+            if (!record.copyable())
+                throw runtime_error("libunrar not found");
+            header.crc32 = record.has_crc32 ? record.crc32 : 0;
+            entries.push_back({ move(header), index, record.size, 0, record.has_crc32, &record });
+        }
+        // with a BLAKE2 hash, which only unrar checks, an entry is copied unverified and given the CRC of what was copied
+        const auto unverified = count_if(begin(entries), end(entries), [](const auto &entry) { return !entry.has_crc32; });
+        if (unverified && !opts.quiet)
+            out << "   " << unverified << " entries with a BLAKE2 hash copied without checking it (libunrar not found)" << endl;
     }
-    if (!opts.quiet)
-        cout << endl;
-
-    hArchive = nullptr;
-
-    const streamoff directory_offset = zip.tellp();
-    using offset_of_directory_type
-        = decltype(pkzip::end_of_central_directory_record
-            ::offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number);
-    if (directory_offset > numeric_limits<offset_of_directory_type>::max())
-        throw runtime_error("large file not supported: " + filename);
-    for (const auto &record : records)
-        zip << record;
-    const streamoff directory_size = zip.tellp() - directory_offset;
-
-    pkzip::end_of_central_directory_record footer;
-    footer.total_number_of_entries_in_the_central_directory_on_this_disk
-        = static_cast<decltype(footer.total_number_of_entries_in_the_central_directory_on_this_disk)>(records.size());
-    footer.total_number_of_entries_in_the_central_directory
-        = static_cast<decltype(footer.total_number_of_entries_in_the_central_directory)>(records.size());
-    footer.size_of_the_central_directory
-        = static_cast<decltype(footer.size_of_the_central_directory)>(directory_size);
-    footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number
-        = static_cast<decltype(footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number)>(directory_offset);
-    zip << footer;
+    // copies do not depend on each other either
+    independent = independent || all_of(begin(entries), end(entries), [](const auto &entry) { return entry.stored; });
+
+    natural_sort(entries, [](const rar_entry &e) -> const auto & { return e.header.file_name; }, opts.jobs);
 
+    const auto zip_path = path.parent_path() / path.filename().replace_extension(".zip");
+    zip_writer zip(zip_path);
+    for (auto &entry : entries)
+        entry.offset = zip.reserve_entry(entry.header, entry.size, entry.size, 0);
+    zip.preallocate();
+
+    // the entries of a non-solid archive do not depend on each other, so they can be extracted in parallel;
+    // those of a solid one, or of one in several volumes, are extracted by a single handle
+    const auto jobs = opts.jobs ? opts.jobs : max(1u, thread::hardware_concurrency());
+    extract(unrar, path, opts, zip, entries, reader ? &*reader : nullptr,
+            independent ? max<size_t>(1, min(jobs, entries.size())) : 1);
     if (!opts.quiet)
-        cout << "   footer written" << endl;
+        out << endl;
 
     zip.close();
+    if (reader)
+        reader->close();
+
+    if (!opts.quiet)
+        out << "   footer written" << endl;
 
     fs::last_write_time(zip_path, fs::last_write_time(path));
 }
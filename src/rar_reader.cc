@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "charset.h"
+#include "crc32.h"
+#include "dostime.h"
+#include "path_ops.h"
+#include "pkzip_layout.h"
+
+#include "rar_reader.h"
+
+using namespace zz;
+using namespace std;
+using namespace std::chrono;
+
+using boost::interprocess::read_only;
+using pkzip::detail::load_le;
+
+static constexpr uint8_t rar4_signature[] = { 'R', 'a', 'r', '!', 0x1A, 0x07, 0x00 };
+static constexpr uint8_t rar5_signature[] = { 'R', 'a', 'r', '!', 0x1A, 0x07, 0x01, 0x00 };
+
+// the fields of a header, read front to back without going past its end
+class cursor
+{
+public:
+    cursor(const uint8_t *begin, const uint8_t *end, const fs::path &filename) noexcept
+        : _p(begin)
+        , _end(end)
+        , _filename(filename)
+    {
+    }
+
+    template <typename value_type>
+    value_type get()
+    {
+        return load_le<value_type>(take(sizeof(value_type)));
+    }
+    // an integer of up to ten bytes, seven bits each, the lowest first
+    uint64_t vint()
+    {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            const auto byte = *take(1);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw runtime_error("invalid header: " + _filename);
+    }
+    const uint8_t * take(uint64_t size)
+    {
+        if (size > static_cast<uint64_t>(_end - _p))
+            throw runtime_error("invalid header: " + _filename);
+        const auto p = _p;
+        _p += size;
+        return p;
+    }
+
+    const uint8_t * position() const noexcept
+    {
+        return _p;
+    }
+    bool empty() const noexcept
+    {
+        return _p == _end;
+    }
+private:
+    const uint8_t  *_p;
+    const uint8_t  *_end;
+    const fs::path &_filename;
+};
+
+static void append_utf8(string &s, char32_t c)
+{
+    if (c < 0x80) {
+        s += static_cast<char>(c);
+    } else if (c < 0x800) {
+        s += static_cast<char>(0xC0 | c >> 6);
+        s += static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        s += static_cast<char>(0xE0 | c >> 12);
+        s += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+        s += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        s += static_cast<char>(0xF0 | c >> 18);
+        s += static_cast<char>(0x80 | (c >> 12 & 0x3F));
+        s += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+        s += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+// Decodes the unicode name a version 4 header stores after the other one and a zero: UTF-16 units, each either
+// given whole, or as a low byte sharing a common high byte, or taken from the other name, corrected or not.
+static string decode_rar4_unicode_name(const uint8_t *name, size_t name_size, const uint8_t *encoded, size_t size)
+{
+    vector<char16_t> units;
+    size_t pos = 0;
+    const auto high = pos < size ? encoded[pos++] : 0;
+    unsigned flags = 0, flag_bits = 0;
+    while (pos < size) {
+        if (flag_bits == 0) {
+            flags     = encoded[pos++];
+            flag_bits = 8;
+            if (pos == size)
+                break;
+        }
+        switch (flags >> 6 & 3) {
+        case 0:
+            units.push_back(encoded[pos++]);
+            break;
+        case 1:
+            units.push_back(static_cast<char16_t>(encoded[pos++] | high << 8));
+            break;
+        case 2:
+            if (pos + 1 >= size)
+                pos = size;
+            else
+                units.push_back(static_cast<char16_t>(encoded[pos] | encoded[pos + 1] << 8)), pos += 2;
+            break;
+        case 3: {
+            const auto length = encoded[pos++];
+            if (length & 0x80) {
+                if (pos == size)
+                    break;
+                const auto correction = encoded[pos++];
+                for (auto n = (length & 0x7F) + 2; n > 0 && units.size() < name_size; n--)
+                    units.push_back(static_cast<char16_t>(((name[units.size()] + correction) & 0xFF) | high << 8));
+            } else {
+                for (auto n = length + 2; n > 0 && units.size() < name_size; n--)
+                    units.push_back(name[units.size()]);
+            }
+            break;
+        }
+        }
+        flags    <<= 2;
+        flag_bits -= 2;
+    }
+
+    string s;
+    for (size_t i = 0; i < units.size(); i++) {
+        char32_t c = units[i];
+        if (c >= 0xD800 && c < 0xDC00 && i + 1 < units.size() && units[i + 1] >= 0xDC00 && units[i + 1] < 0xE000)
+            c = 0x10000 + ((c - 0xD800) << 10 | (units[++i] - 0xDC00));
+        append_utf8(s, c);
+    }
+    return s;
+}
+
+static uint32_t dos_date_time_of(sys_seconds t)
+{
+    const auto [date, time] = to_dos_date_time(time_point_cast<file_clock::duration>(file_clock::from_sys(t)));
+    return static_cast<uint32_t>(date) << 16 | time;
+}
+
+rar_reader::rar_reader(const fs::path &path, const string &charset)
+    : _path(path)
+    , _file(path.c_str(), read_only)
+    , _region(_file, read_only)
+{
+    if (size() >= sizeof rar5_signature && memcmp(begin(), rar5_signature, sizeof rar5_signature) == 0)
+        read_rar5();
+    else if (size() >= sizeof rar4_signature && memcmp(begin(), rar4_signature, sizeof rar4_signature) == 0)
+        read_rar4(charset);
+    else
+        throw runtime_error("unsupported archive format: " + _path.filename());
+}
+
+void rar_reader::read_rar4(const string &charset)
+{
+    const auto filename = _path.filename();
+    const auto p = begin();
+    const auto n = size();
+
+    // each block starts with its CRC, type, flags and header size, then the size of the data after the header
+    for (auto offset = static_cast<uint64_t>(sizeof rar4_signature); n - offset >= 7; ) {
+        const auto type      = p[offset + 2];
+        const auto flags     = load_le<uint16_t>(p + offset + 3);
+        const auto head_size = load_le<uint16_t>(p + offset + 5);
+        if (head_size < 7 || head_size > n - offset)
+            throw runtime_error("invalid header: " + filename);
+        cursor h(p + offset + 7, p + offset + head_size, filename);
+        uint64_t data_size = flags & 0x8000 ? h.get<uint32_t>() : 0;
+
+        switch (type) {
+        case 0x73:  // archive
+            if (flags & 0x0080)
+                throw runtime_error("encryption not supported: " + filename);
+            _volume = flags & 0x0001;
+            _solid  = flags & 0x0008;
+            break;
+        case 0x74:  // file
+        case 0x7A: {    // service data, such as a comment or a stream
+            if ((update_crc32(0, p + offset + 2, head_size - 2u) & 0xFFFF) != load_le<uint16_t>(p + offset))
+                throw runtime_error("invalid header: " + filename);
+            if (!(flags & 0x8000))
+                data_size = h.get<uint32_t>();
+            uint64_t size = h.get<uint32_t>();
+            const auto host_os    = h.get<uint8_t>();
+            const auto crc32      = h.get<uint32_t>();
+            const auto time       = h.get<uint32_t>();
+            h.get<uint8_t>();   // version needed
+            const auto method     = h.get<uint8_t>();
+            const auto name_size  = h.get<uint16_t>();
+            const auto attributes = h.get<uint32_t>();
+            if (flags & 0x0100) {
+                data_size |= static_cast<uint64_t>(h.get<uint32_t>()) << 32;
+                size      |= static_cast<uint64_t>(h.get<uint32_t>()) << 32;
+            }
+            const auto name = h.take(name_size);
+            if (type != 0x74)
+                break;
+
+            rar_record record;
+            if (flags & 0x0200) {
+                const auto zero = find(name, name + name_size, 0);
+                record.name = charset::decode_utf8(zero == name + name_size
+                    ? string(reinterpret_cast<const char *>(name), name_size)
+                    : decode_rar4_unicode_name(name, static_cast<size_t>(zero - name),
+                                               zero + 1, static_cast<size_t>(name + name_size - zero - 1)));
+            } else {
+                record.name = charset::decode(string(reinterpret_cast<const char *>(name), name_size), charset);
+            }
+            record.size          = size;
+            record.packed_size   = data_size;
+            record.data_offset   = offset + head_size;
+            record.dos_date_time = time;
+            record.crc32         = crc32;
+            record.has_crc32     = true;
+            record.directory     = (flags & 0x00E0) == 0x00E0;
+            record.encrypted     = flags & 0x0004;
+            record.split         = flags & 0x0003;
+            record.stored        = method == 0x30;
+            record.link          = host_os == 3 && (attributes & 0xF000) == 0xA000;
+            _records.push_back(move(record));
+            break;
+        }
+        case 0x7B:  // end of archive
+            return;
+        }
+
+        if (data_size > n - offset - head_size)
+            throw runtime_error("truncated archive: " + filename);
+        offset += head_size + data_size;
+    }
+}
+
+void rar_reader::read_rar5()
+{
+    const auto filename = _path.filename();
+    const auto p = begin();
+    const auto n = size();
+
+    // each header starts with its CRC and its size, counted from the type on
+    for (auto offset = static_cast<uint64_t>(sizeof rar5_signature); n - offset >= 7; ) {
+        cursor c(p + offset + 4, p + n, filename);
+        const auto head_size = c.vint();
+        const auto head = c.position();
+        if (head_size > static_cast<uint64_t>(p + n - head))
+            throw runtime_error("invalid header: " + filename);
+        if (update_crc32(0, p + offset + 4, static_cast<size_t>(head - p - offset - 4 + head_size)) != load_le<uint32_t>(p + offset))
+            throw runtime_error("invalid header: " + filename);
+        cursor h(head, head + head_size, filename);
+        const auto type       = h.vint();
+        const auto flags      = h.vint();
+        const auto extra_size = flags & 0x0001 ? h.vint() : 0;
+        const auto data_size  = flags & 0x0002 ? h.vint() : 0;
+        const auto data_offset = static_cast<uint64_t>(head - p) + head_size;
+        if (extra_size > head_size || data_size > n - data_offset)
+            throw runtime_error("truncated archive: " + filename);
+
+        switch (type) {
+        case 1: {   // main archive header
+            const auto archive_flags = h.vint();
+            _volume = archive_flags & 0x0001;
+            _solid  = archive_flags & 0x0004;
+            break;
+        }
+        case 2: {   // file
+            rar_record record;
+            const auto file_flags = h.vint();
+            record.size = h.vint();
+            h.vint();   // attributes
+            auto has_time = false;
+            sys_seconds mtime;
+            if (file_flags & 0x0002) {
+                mtime    = sys_seconds(seconds(h.get<uint32_t>()));
+                has_time = true;
+            }
+            if (file_flags & 0x0004) {
+                record.crc32     = h.get<uint32_t>();
+                record.has_crc32 = true;
+            }
+            const auto compression = h.vint();
+            h.vint();   // host OS
+            const auto name_size = h.vint();
+            const auto name = h.take(name_size);
+            record.name = charset::decode_utf8(string(reinterpret_cast<const char *>(name), static_cast<size_t>(name_size)));
+
+            cursor extra(head + head_size - extra_size, head + head_size, filename);
+            while (!extra.empty()) {
+                const auto record_size = extra.vint();
+                const auto record_begin = extra.take(record_size);
+                cursor e(record_begin, record_begin + record_size, filename);
+                switch (e.vint()) {
+                case 0x01:  // encryption
+                    record.encrypted = true;
+                    break;
+                case 0x03: {    // times, in Unix or Windows format
+                    const auto time_flags = e.vint();
+                    if (time_flags & 0x0002) {
+                        mtime = time_flags & 0x0001
+                              ? sys_seconds(seconds(e.get<uint32_t>()))
+                              : sys_seconds(seconds(static_cast<int64_t>(e.get<uint64_t>() / 10'000'000) - 11'644'473'600));
+                        has_time = true;
+                    }
+                    break;
+                }
+                case 0x05:  // redirection
+                    record.link = true;
+                    break;
+                }
+            }
+
+            record.packed_size   = data_size;
+            record.data_offset   = data_offset;
+            record.dos_date_time = has_time ? dos_date_time_of(mtime) : 0;
+            record.directory     = file_flags & 0x0001;
+            record.split         = flags & (0x0008 | 0x0010);
+            // an unknown size leaves the data to be read through to its end
+            record.stored        = (compression >> 7 & 7) == 0 && !(file_flags & 0x0008);
+            _records.push_back(move(record));
+            break;
+        }
+        case 4:     // archive encryption: every other header is encrypted
+            throw runtime_error("encryption not supported: " + filename);
+        case 5:     // end of archive
+            return;
+        }
+
+        offset = data_offset + data_size;
+    }
+}
+
+void rar_reader::close() noexcept
+{
+    _region = boost::interprocess::mapped_region();
+    _file   = boost::interprocess::file_mapping();
+}
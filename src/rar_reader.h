@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "config.h"
+
+namespace zz
+{
+    /// An entry of a rar archive, as described by its header.
+    struct rar_record
+    {
+        fs::path::string_type name;
+        uint64_t              size          = 0;    // unpacked
+        uint64_t              packed_size   = 0;
+        uint64_t              data_offset   = 0;
+        uint32_t              dos_date_time = 0;    // date in the high half, as libunrar gives it
+        uint32_t              crc32         = 0;
+        bool                  has_crc32     = false;    // or a BLAKE2 hash, or nothing
+        bool                  directory     = false;
+        bool                  encrypted     = false;
+        bool                  split         = false;    // continued from or in another volume
+        bool                  stored        = false;    // packed without compression
+        bool                  link          = false;    // a symbolic or hard link, or a copy of another entry
+
+        /// Whether the packed data is the file itself, to be copied as is.
+        bool copyable() const noexcept
+        {
+            return stored && !encrypted && !split && !link && !directory && packed_size == size;
+        }
+    };
+
+    /// Maps a rar archive, version 4 or 5, and lists its entries from their headers, without decompressing anything.
+    class rar_reader
+    {
+        rar_reader(const rar_reader &) = delete;
+        rar_reader & operator = (const rar_reader &) = delete;
+    public:
+        /// Names not marked as unicode in a version 4 archive are decoded from the given charset.
+        rar_reader(const fs::path &, const std::string &charset);
+
+        const std::vector<rar_record> & records() const noexcept
+        {
+            return _records;
+        }
+        std::string_view data(const rar_record &record) const noexcept
+        {
+            return std::string_view(reinterpret_cast<const char *>(begin() + record.data_offset),
+                                    static_cast<size_t>(record.packed_size));
+        }
+        /// Whether the archive is one of several volumes, whose other entries are not listed.
+        bool volume() const noexcept
+        {
+            return _volume;
+        }
+        bool solid() const noexcept
+        {
+            return _solid;
+        }
+
+        void close() noexcept;
+    private:
+        void read_rar4(const std::string &charset);
+        void read_rar5();
+
+        const uint8_t * begin() const noexcept
+        {
+            return static_cast<const uint8_t *>(_region.get_address());
+        }
+        uint64_t size() const noexcept
+        {
+            return _region.get_size();
+        }
+
+        fs::path                           _path;
+        boost::interprocess::file_mapping  _file;
+        boost::interprocess::mapped_region _region;
+        std::vector<rar_record>            _records;
+        bool                               _volume = false;
+        bool                               _solid  = false;
+    };
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <type_traits>
 
 namespace
 {
@@ -119,6 +124,24 @@ namespace
                 return diff;
         }
     }
+
+    // ends a sort key whose string ends with spaces, which sort after its end but before anything else
+    static constexpr char key_trailing_spaces = 0;
+
+    // appends a character to a sort key, big-endian and ordered the way the character type compares;
+    // units starting with a byte below 2 are escaped by a 1 to stay above key_trailing_spaces
+    template <typename char_type>
+    static inline void put_key_unit(std::string &key, char_type ch)
+    {
+        using unsigned_type = std::make_unsigned_t<char_type>;
+        auto value = static_cast<unsigned_type>(ch);
+        if constexpr (std::is_signed_v<char_type>)
+            value ^= static_cast<unsigned_type>(1u << (sizeof(char_type) * CHAR_BIT - 1));
+        if ((value >> (sizeof(char_type) * CHAR_BIT - 8)) < 2)
+            key.push_back(1);
+        for (auto shift = sizeof(char_type) * CHAR_BIT; shift; )
+            key.push_back(static_cast<char>((value >> (shift -= CHAR_BIT)) & 0xff));
+    }
 }
 
 template <typename iterator_type>
@@ -144,3 +167,57 @@ inline int strnatcasecmp(const std::basic_string<char_type> &lhs, const std::bas
 {
     return strnatcasecmp(std::begin(lhs), std::end(lhs), std::begin(rhs), std::end(rhs));
 }
+
+/// Turns a string into a key whose byte order is the order of strnatcasecmp,
+/// so that sorting tokenizes each string once instead of at every comparison.
+template <typename iterator_type>
+std::string strnatcasekey(iterator_type begin, iterator_type end)
+{
+    using char_type = typename std::iterator_traits<iterator_type>::value_type;
+
+    std::string key;
+    key.reserve(static_cast<size_t>(std::distance(begin, end)) * (sizeof(char_type) + 1) + 8);
+    while (begin != end && *begin == '0' && std::next(begin) != end && is_digit(*std::next(begin)))
+        ++begin;
+    for (auto after_digits = false; begin != end; ) {
+        if (is_digit(*begin)) {
+            const auto first = begin;
+            while (begin != end && is_digit(*begin))
+                ++begin;
+            if (*first == '0') {
+                // compared digit by digit, a run that stops first being the smaller
+                for (auto it = first; it != begin; ++it)
+                    put_key_unit(key, *it);
+                put_key_unit(key, static_cast<char_type>('0' - 1));
+            } else {
+                // compared by length first, then digit by digit
+                const auto length = static_cast<uint32_t>(std::min<uintmax_t>(std::distance(first, begin), UINT32_MAX));
+                put_key_unit(key, static_cast<char_type>('1'));
+                for (auto shift = 32; shift; )
+                    key.push_back(static_cast<char>((length >> (shift -= 8)) & 0xff));
+                for (auto it = first; it != begin; ++it)
+                    put_key_unit(key, *it);
+            }
+            after_digits = true;
+            continue;
+        }
+        // spaces are skipped, except the character right after a number and the spaces ending the string
+        if (!after_digits && is_space(*begin)) {
+            while (begin != end && is_space(*begin))
+                ++begin;
+            if (begin == end)
+                key.push_back(key_trailing_spaces);
+            continue;
+        }
+        put_key_unit(key, to_upper(*begin));
+        after_digits = false;
+        ++begin;
+    }
+    return key;
+}
+
+template <typename char_type>
+inline std::string strnatcasekey(const std::basic_string<char_type> &s)
+{
+    return strnatcasekey(std::begin(s), std::end(s));
+}
@@ -1,110 +1,328 @@
 #include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 
 #ifdef _MSC_VER
 #pragma warning(push)
-#pragma warning(disable: 4706)
+#pragma warning(disable: 4244 4245)
 #endif
-#include <boost/iostreams/filter/zlib.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/interprocess/streams/bufferstream.hpp>
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
+#include "crc32.h"
+#include "exclude.h"
+#include "file.h"
 #include "filename.h"
+#include "inflate.h"
+#include "natural_sort.h"
 #include "path_ops.h"
 #include "pkzip_io.h"
+#include "pkzip_layout.h"
 #include "strnatcmp.h"
 #include "trash.h"
+#include "zip_reader.h"
+#include "zip_writer.h"
 
 #include "zip2zip.h"
 
 using namespace zz;
 using namespace std;
 
-using boost::iostreams::filtering_istream;
-using boost::iostreams::zlib_decompressor;
-using boost::iostreams::zlib_params;
+using boost::interprocess::ibufferstream;
 
-template <typename size_type>
-static inline auto & copy_n(io::ifstream &source, size_type count, io::ofstream &dest)
+using file_attributes_type = decltype(pkzip::central_file_header::external_file_attributes);
+struct entry_t
 {
-    constexpr size_type buffer_size = 8192;
-    char buffer[buffer_size];
-    for (streamsize read; (read = source.read(buffer, min(buffer_size, count)).gcount()) > 0; count -= static_cast<size_type>(read))
-        dest.write(buffer, read);
-    return dest;
+    pkzip::local_file_header           header;
+    file_attributes_type               file_attributes;
+    const pkzip::central_file_header  *source;
+    uint64_t                           compressed_size;
+    uint64_t                           uncompressed_size;
+};
+
+// An in-place rewrite first saves the original bytes of every region it overwrites in a journal,
+// so that a rewrite cut short by a crash is rolled back the next time the file is converted.
+// The journal also identifies the archive it belongs to by the sizes the rewrite can leave it at
+// and the CRC-32 of a run of bytes the rewrite does not touch, so that it is never applied to
+// an archive that was replaced or changed since.
+static constexpr uint32_t journal_signature = '0' | 'z' << 8 | 'J' << 16 | '2' << 24;
+static constexpr uint64_t journal_sample_size = 1 << 16;
+
+struct journal_identity
+{
+    uint64_t original_size = 0;
+    uint64_t new_size      = 0;
+    uint64_t sample_offset = 0;
+    uint64_t sample_size   = 0;
+    uint32_t sample_crc32  = 0;
+};
+
+static inline auto journal_path(const fs::path &path)
+{
+    return path.parent_path() / (path.filename() + ".journal");
+}
+
+static void write_journal(const fs::path &path, const journal_identity &identity,
+                          const vector<pair<uint64_t, string_view>> &regions)
+{
+    string journal;
+    const auto append = [&journal](auto value) {
+        uint8_t buf[sizeof value];
+        pkzip::detail::store_le(buf, value);
+        journal.append(reinterpret_cast<const char *>(buf), sizeof buf);
+    };
+    append(journal_signature);
+    append(identity.original_size);
+    append(identity.new_size);
+    append(identity.sample_offset);
+    append(identity.sample_size);
+    append(identity.sample_crc32);
+    append(static_cast<uint64_t>(regions.size()));
+    for (const auto &[offset, bytes] : regions) {
+        append(offset);
+        append(static_cast<uint64_t>(bytes.size()));
+        journal.append(bytes);
+    }
+    append(update_crc32(0, journal.data(), journal.size()));
+
+    file f(journal_path(path));
+    f.write_at(journal.data(), journal.size(), 0);
+    f.sync();
+    f.close();
+    file::sync_directory(fs::absolute(path).parent_path());
+}
+
+static bool matches(const file &f, uint64_t size, const journal_identity &identity)
+{
+    // the rewrite writes the tail past the old end before it resizes the file
+    if (size != identity.original_size && size != identity.new_size &&
+        size != max(identity.original_size, identity.new_size))
+        return false;
+    string sample(static_cast<size_t>(identity.sample_size), '\0');
+    return f.read_at(sample.data(), sample.size(), identity.sample_offset) == sample.size() &&
+           update_crc32(0, sample.data(), sample.size()) == identity.sample_crc32;
+}
+
+static void recover_journal(const fs::path &path, const options &opts)
+{
+    auto &out = *opts.out;
+    const auto jpath = journal_path(path);
+    if (!fs::exists(jpath))
+        return;
+
+    string journal(static_cast<size_t>(fs::file_size(jpath)), '\0');
+    {
+        io::ifstream is;
+        is.exceptions(ios::failbit | ios::badbit);
+        is.open(jpath, ios::binary);
+        is.read(journal.data(), ssize(journal));
+    }
+    using pkzip::detail::load_le;
+    const auto p = reinterpret_cast<const uint8_t *>(journal.data());
+    const auto n = journal.size();
+    // a journal that is not complete was never acted on
+    if (n < 52 || load_le<uint32_t>(p) != journal_signature ||
+        load_le<uint32_t>(p + n - 4) != update_crc32(0, p, n - 4)) {
+        fs::remove(jpath);
+        return;
+    }
+
+    journal_identity identity;
+    identity.original_size = load_le<uint64_t>(p + 4);
+    identity.new_size      = load_le<uint64_t>(p + 12);
+    identity.sample_offset = load_le<uint64_t>(p + 20);
+    identity.sample_size   = load_le<uint64_t>(p + 28);
+    identity.sample_crc32  = load_le<uint32_t>(p + 36);
+    const auto count       = load_le<uint64_t>(p + 40);
+    if (identity.sample_size > journal_sample_size)
+        throw runtime_error("invalid journal: " + jpath.filename());
+
+    file f(path, file::read_write);
+    // the journal is kept, for the user to look into, rather than written over another archive
+    if (!matches(f, fs::file_size(path), identity))
+        throw runtime_error("journal does not match the archive: " + jpath.filename());
+    size_t i = 48;
+    for (uint64_t k = 0; k < count; k++) {
+        if (n - 4 - i < 16)
+            throw runtime_error("invalid journal: " + jpath.filename());
+        const auto offset = load_le<uint64_t>(p + i);
+        const auto size   = load_le<uint64_t>(p + i + 8);
+        i += 16;
+        if (n - 4 - i < size)
+            throw runtime_error("invalid journal: " + jpath.filename());
+        f.write_at(p + i, static_cast<size_t>(size), offset);
+        i += static_cast<size_t>(size);
+    }
+    f.resize(identity.original_size);
+    f.sync();
+    f.close();
+    fs::remove(jpath);
+
+    if (!opts.quiet)
+        out << "   interrupted rewrite rolled back" << endl;
+}
+
+// Rewrites the headers and the central directory of a stored archive in place, provided that the data
+// would not move: the entries must be stored back to back in their final order, and every new local
+// header must be as long as the old one. Returns false, touching nothing, when that does not hold.
+static bool rewrite_in_place(const fs::path &path, zip_reader &zip, const vector<entry_t> &entries,
+                             const options &opts)
+{
+    auto &out = *opts.out;
+    if (entries.size() != zip.records().size())
+        return false;
+
+    const auto contents = zip.contents();
+    vector<pair<uint64_t, string>> changes;
+    vector<pair<uint64_t, string_view>> originals;
+    vector<pkzip::central_file_header> records;
+    ostringstream ss;
+    uint64_t end = 0;
+    for (const auto &entry : entries) {
+        const auto &record = *entry.source;
+        if (record.compression_method != pkzip::compression_method::stored)
+            return false;
+        const auto offset = pkzip::get_relative_offset_of_local_header(record);
+        if (offset != end)
+            return false;
+        const auto data_offset = zip.data_offset(record);
+        const auto original = contents.substr(static_cast<size_t>(offset), static_cast<size_t>(data_offset - offset));
+
+        // the local extra field is kept as it is, so that the header keeps its length
+        pkzip::local_file_header local(opts.charsets.first);
+        ibufferstream(original.data(), original.size()) >> local;
+        auto header = entry.header;
+        header.extra_field = local.extra_field;
+        pkzip::set_sizes(header, entry.compressed_size, entry.uncompressed_size);
+        ss.str({});
+        ss << header;
+        if (ss.view().size() != original.size())
+            return false;
+        if (ss.view() != original) {
+            changes.emplace_back(offset, ss.view());
+            originals.emplace_back(offset, original);
+        }
+
+        records.push_back(pkzip::make_central_file_header(entry.header, entry.compressed_size, entry.uncompressed_size,
+                                                          offset, entry.file_attributes));
+        end = data_offset + entry.compressed_size;
+    }
+
+    ss.str({});
+    for (const auto &record : records)
+        ss << record;
+    const auto directory_size = static_cast<uint64_t>(ss.tellp());
+    pkzip::write_end_of_central_directory(ss, records.size(), end, directory_size);
+    const auto tail = ss.str();
+    const auto original_tail = contents.substr(static_cast<size_t>(end));
+    if (changes.empty() && tail == original_tail) {
+        if (!opts.quiet)
+            out << "   already normalized" << endl;
+        return true;
+    }
+    originals.emplace_back(end, original_tail);
+
+    // the sample ends the last run of bytes before the tail that no region covers
+    auto sample_begin = uint64_t(0), sample_end = end;
+    for (auto it = originals.rbegin() + 1; it != originals.rend(); ++it) {
+        const auto region_end = it->first + it->second.size();
+        if (region_end < sample_end) {
+            sample_begin = region_end;
+            break;
+        }
+        sample_end = it->first;
+    }
+    journal_identity identity;
+    identity.original_size = contents.size();
+    identity.new_size      = end + tail.size();
+    identity.sample_size   = min(sample_end - sample_begin, journal_sample_size);
+    identity.sample_offset = sample_end - identity.sample_size;
+    identity.sample_crc32  = update_crc32(0, contents.data() + identity.sample_offset, static_cast<size_t>(identity.sample_size));
+
+    const auto mtime = fs::last_write_time(path);
+    write_journal(path, identity, originals);
+    zip.close();
+
+    file f(path, file::read_write);
+    for (const auto &[offset, bytes] : changes)
+        f.write_at(bytes.data(), bytes.size(), offset);
+    f.write_at(tail.data(), tail.size(), end);
+    f.resize(end + tail.size());
+    f.sync();
+    f.close();
+    fs::remove(journal_path(path));
+
+    fs::last_write_time(path, mtime);
+
+    if (!opts.quiet)
+        out << "   " << changes.size() << " headers and the central directory rewritten in place" << endl;
+    return true;
 }
 
 void zz::zip2zip(const fs::path &path, const options &opts)
 {
+    auto &out = *opts.out;
     const auto filename = path.filename();
-    const auto filesize = fs::file_size(path);
 
-    io::ifstream zip;
-    zip.exceptions(ios::failbit | ios::badbit);
-    zip.open(path, ios::binary);
+    recover_journal(path, opts);
+
+    // like an archive without entries, a file too short to hold the end record is left as it is
+    if (fs::file_size(path) < pkzip::layout<pkzip::end_of_central_directory_record>::size) {
+        if (!opts.quiet)
+            out << endl;
+        return;
+    }
+
+    zip_reader zip(path, opts.charsets.first);
 
-    using file_attributes_type = decltype(pkzip::central_file_header::external_file_attributes);
-    struct entry_t
-    {
-        pkzip::local_file_header header;
-        file_attributes_type     file_attributes;
-        streamoff                offset;
-    };
     vector<entry_t> entries;
-    for (pkzip::local_file_header header(opts.charsets.first); zip >> header && header; zip.seekg(entries.back().offset + header.compressed_size)) {
-        if (header.general_purpose_bit_flag & pkzip::general_purpose_bit_flags::file_is_encrypted)
+    entries.reserve(zip.records().size());
+    for (const auto &record : zip.records()) {
+        if (record.general_purpose_bit_flag & pkzip::general_purpose_bit_flags::file_is_encrypted)
             throw runtime_error("encryption not supported: " + filename);
-        if (header.general_purpose_bit_flag & pkzip::general_purpose_bit_flags::has_data_descriptor)
-            throw runtime_error("data descriptor not supported: " + filename);
-        const streamoff offset = zip.tellg();
-        if (static_cast<decltype(filesize)>(offset + header.compressed_size) > filesize)
-            break;
-        header.charset = opts.charsets.second;
+        pkzip::local_file_header header(opts.charsets.second);
+        header.version_needed_to_extract = record.version_needed_to_extract;
+        header.general_purpose_bit_flag  = record.general_purpose_bit_flag
+                                         & ~pkzip::general_purpose_bit_flags::has_data_descriptor;
+        header.compression_method        = record.compression_method;
+        header.last_mod_file_time        = record.last_mod_file_time;
+        header.last_mod_file_date        = record.last_mod_file_date;
+        header.crc32                     = record.crc32;
+        header.file_name                 = record.file_name;
+        header.extra_field               = record.extra_field;
         if (strnatcasecmp(header.charset, "utf8"s) == 0)
             header.general_purpose_bit_flag |=  pkzip::general_purpose_bit_flags::use_utf8;
         else
             header.general_purpose_bit_flag &= ~pkzip::general_purpose_bit_flags::use_utf8;
-        entries.push_back(entry_t{ header, 0, offset });
-        using total_number_of_entries_type
-            = decltype(pkzip::end_of_central_directory_record::total_number_of_entries_in_the_central_directory);
-        if (entries.size() > numeric_limits<total_number_of_entries_type>::max())
-            throw runtime_error("too many entries: " + filename);
+        const auto file_attributes = (record.version_made_by & 0xFF00) == pkzip::version_made_by::msdos
+                                   ? record.external_file_attributes
+                                   : 0;
+        entries.push_back(entry_t{ header, file_attributes, &record,
+                                   pkzip::get_compressed_size(record), pkzip::get_uncompressed_size(record) });
 
         if (!opts.quiet)
-            cout << "\r   " << dec << setw(3) << setfill('0') << entries.size() << " entries read";
+            out << "\r   " << dec << setw(3) << setfill('0') << entries.size() << " entries read";
     }
     if (!opts.quiet)
-        cout << endl;
+        out << endl;
 
     if (entries.empty())
         return;
 
-    zip.seekg(entries.back().offset + entries.back().header.compressed_size);
-    for (entry_t &e : entries) {
-        pkzip::central_file_header record(opts.charsets.first);
-        zip >> record;
-        if (!record)
-            break;
-        if ((record.version_made_by & 0xFF00) == pkzip::version_made_by::msdos)
-            e.file_attributes = record.external_file_attributes;
-    }
-
-    zip.clear();
-
-    for (const basic_string_view<pkzip::char_type> x : opts.excludes) {
-        entries.erase(remove_if(begin(entries), end(entries), [x](const auto &e) {
-            return x.starts_with('*') ? e.header.file_name.ends_with(x.substr(1)) : e.header.file_name == x;
-        }), end(entries));
-    }
+    const exclude_matcher excluded(opts.excludes);
+    entries.erase(remove_if(begin(entries), end(entries), [&excluded](const auto &e) {
+        return excluded(e.header.file_name);
+    }), end(entries));
 
-    sort(begin(entries), end(entries), [](const auto &lhs, const auto &rhs) {
-        return strnatcasecmp(lhs.header.file_name, rhs.header.file_name) < 0;
-    });
+    natural_sort(entries, [](const entry_t &e) -> const auto & { return e.header.file_name; }, opts.jobs);
 
     if (opts.rename) {
         entries.erase(remove_if(begin(entries), end(entries), [](const auto &e) {
@@ -120,97 +338,152 @@ void zz::zip2zip(const fs::path &path, const options &opts)
         }
     }
 
-    const auto tmp_path = path.parent_path() / path.filename().replace_extension(".tmp");
-    io::ofstream tmp;
-    tmp.exceptions(ios::failbit | ios::badbit);
-    tmp.open(tmp_path, ios::binary);
+    if (opts.in_place && rewrite_in_place(path, zip, entries, opts))
+        return;
 
-    const auto tmp_name = tmp_path.filename();
+    const auto tmp_path = path.parent_path() / path.filename().replace_extension(".tmp");
+    zip_writer tmp(tmp_path);
 
-    vector<pkzip::central_file_header> records;
+    // every size is known up front, so all the headers are laid out before any data is written
+    vector<uint64_t> offsets;
+    offsets.reserve(entries.size());
     for (auto &entry : entries) {
-        const streamoff offset = tmp.tellp();
-        if (offset > numeric_limits<decltype(pkzip::central_file_header::relative_offset_of_local_header)>::max())
-            throw runtime_error("large file not supported: " + filename);
-
-        pkzip::central_file_header record(opts.charsets.second);
-        record.version_made_by                 = entry.header.version_needed_to_extract | pkzip::version_made_by::msdos;
-        record.version_needed_to_extract       = entry.header.version_needed_to_extract;
-        record.general_purpose_bit_flag        = entry.header.general_purpose_bit_flag;
-        record.compression_method              = entry.header.compression_method;
-        record.last_mod_file_time              = entry.header.last_mod_file_time;
-        record.last_mod_file_date              = entry.header.last_mod_file_date;
-        record.crc32                           = entry.header.crc32;
-        record.compressed_size                 = entry.header.compressed_size;
-        record.uncompressed_size               = entry.header.uncompressed_size;
-        record.external_file_attributes        = entry.file_attributes;
-        record.relative_offset_of_local_header = static_cast<decltype(record.relative_offset_of_local_header)>(offset);
-        record.file_name                       = entry.header.file_name;
-        record.extra_field                     = entry.header.extra_field;
-
-        zip.seekg(entry.offset);
         if (entry.header.compression_method == pkzip::compression_method::deflated) {
-            vector<char> buf(entry.header.uncompressed_size);
-            zlib_params z;
-            z.noheader = true;
-            filtering_istream dec;
-            dec.push(zlib_decompressor(z));
-            dec.push(zip);
-            dec.read(data(buf), size(buf));
-            record.compression_method = entry.header.compression_method = pkzip::compression_method::stored;
-            record.compressed_size    = entry.header.compressed_size    = entry.header.uncompressed_size;
-            tmp << entry.header;
-            tmp.write(data(buf), size(buf));
+            entry.header.compression_method = pkzip::compression_method::stored;
+            offsets.push_back(tmp.reserve_entry(entry.header, entry.uncompressed_size, entry.uncompressed_size,
+                                                entry.file_attributes));
         } else {
-            tmp << entry.header;
-            copy_n(zip, entry.header.compressed_size, tmp);
+            offsets.push_back(tmp.reserve_entry(entry.header, entry.compressed_size, entry.uncompressed_size,
+                                                entry.file_attributes));
         }
-
-        records.push_back(record);
-
-        if (!opts.quiet)
-            cout << "\r   " << dec << setw(3) << setfill('0') << records.size() << " entries written";
     }
+    tmp.preallocate();
+
+    // stored data is moved by the kernel where it can, and written from the mapping otherwise
+    const file source(path, file::read_only);
+    atomic<size_t> copies[3] = {};
+    // returns whether the data matches its CRC-32, wherever it goes through this process: stored data that the
+    // kernel clones or copies is never read here, so it is taken as it is
+    const auto copy_entry = [&](const entry_t &entry, uint64_t offset, vector<char> &buf) {
+        const auto payload = zip.data(*entry.source);
+        if (entry.source->compression_method != pkzip::compression_method::deflated) {
+            const auto method = tmp.copy_range(source, zip.data_offset(*entry.source), payload.size(), offset);
+            copies[static_cast<size_t>(method)]++;
+            if (method != copy_method::none)
+                return true;
+            // written from the mapping piece by piece, each piece checked while it is still in the cache
+            const auto stored = entry.source->compression_method == pkzip::compression_method::stored;
+            crc32_t crc32;
+            for (size_t done = 0; done < payload.size(); ) {
+                const auto n = min(payload.size() - done, buf.size());
+                if (stored)
+                    crc32.process_bytes(payload.data() + done, n);
+                tmp.write_at(payload.data() + done, n, offset + done);
+                done += n;
+            }
+            return !stored || crc32() == entry.header.crc32;
+        }
+        auto &inflater = inflater::get();
+        crc32_t crc32;
+        if (entry.uncompressed_size <= buf.size()) {
+            // small enough to be decoded in one go
+            const auto size = static_cast<size_t>(entry.uncompressed_size);
+            if (!inflater.inflate(payload, data(buf), size))
+                throw runtime_error("invalid deflate stream: " + fs::path(entry.header.file_name));
+            crc32.process_bytes(data(buf), size);
+            tmp.write_at(data(buf), size, offset);
+        } else {
+            // inflated through a fixed buffer, so memory stays bounded whatever the entry size
+            inflater.reset(payload);
+            uint64_t written = 0;
+            for (size_t n; ; written += n) {
+                if (!inflater.read(data(buf), size(buf), n))
+                    throw runtime_error("invalid deflate stream: " + fs::path(entry.header.file_name));
+                if (n == 0)
+                    break;
+                if (n > entry.uncompressed_size - written)
+                    throw runtime_error("size mismatch: " + fs::path(entry.header.file_name));
+                crc32.process_bytes(data(buf), n);
+                tmp.write_at(data(buf), n, offset + written);
+            }
+            if (written != entry.uncompressed_size)
+                throw runtime_error("size mismatch: " + fs::path(entry.header.file_name));
+        }
+        return crc32() == entry.header.crc32;
+    };
+
+    // each worker takes the next entry and writes it at its own offset, with a buffer of its own
+    const auto jobs = min<size_t>(opts.jobs ? opts.jobs : max(1u, thread::hardware_concurrency()), entries.size());
+    atomic<size_t> next = 0;
+    size_t done = 0;
+    mutex guard;
+    exception_ptr error;
+    vector<size_t> skipped;
+    const auto work = [&] {
+        vector<char> buf(opts.buffer_size);
+        for (size_t i; (i = next++) < entries.size(); ) {
+            try {
+                if (!copy_entry(entries[i], offsets[i], buf)) {
+                    const auto name = fs::path(entries[i].header.file_name);
+                    if (opts.crc_policy == crc_policy::fatal)
+                        throw runtime_error("crc32 mismatch: " + name);
+                    lock_guard lock(guard);
+                    if (opts.crc_policy == crc_policy::skip)
+                        skipped.push_back(i);
+                    if (!opts.quiet)
+                        out << endl;
+                    out << (opts.crc_policy == crc_policy::skip ? "   crc32 mismatch, skipped: " : "   crc32 mismatch: ") + name
+                        << endl;
+                }
+            } catch (...) {
+                lock_guard lock(guard);
+                if (!error)
+                    error = current_exception();
+                next = entries.size();
+                return;
+            }
+            if (!opts.quiet) {
+                lock_guard lock(guard);
+                out << "\r   " << dec << setw(3) << setfill('0') << ++done << " entries written" << flush;
+            }
+        }
+    };
+    vector<thread> workers;
+    for (size_t i = 1; i < jobs; i++)
+        workers.emplace_back(work);
+    work();
+    for (auto &worker : workers)
+        worker.join();
+    if (error)
+        rethrow_exception(error);
     if (!opts.quiet)
-        cout << endl;
+        out << endl;
+    // the data of a skipped entry stays where it was laid out, but nothing refers to it any more
+    sort(begin(skipped), end(skipped), greater<>());
+    for (const auto i : skipped)
+        tmp.discard_entry(i);
+    if (opts.verbose) {
+        static constexpr const char *names[] = { "write", "clone", "copy_file_range" };
+        for (size_t i = 0; i < size(names); i++)
+            if (copies[i])
+                out << "   " << copies[i] << " stored entries copied by " << names[i] << endl;
+    }
 
     zip.close();
-
-    const streamoff directory_offset = tmp.tellp();
-    using offset_of_directory_type
-        = decltype(pkzip::end_of_central_directory_record
-            ::offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number);
-    if (directory_offset > numeric_limits<offset_of_directory_type>::max())
-        throw runtime_error("large file not supported: " + filename);
-    for (const auto &record : records)
-        tmp << record;
-    const streamoff directory_size = tmp.tellp() - directory_offset;
-
-    pkzip::end_of_central_directory_record footer;
-    footer.total_number_of_entries_in_the_central_directory_on_this_disk
-        = static_cast<decltype(footer.total_number_of_entries_in_the_central_directory_on_this_disk)>(records.size());
-    footer.total_number_of_entries_in_the_central_directory
-        = static_cast<decltype(footer.total_number_of_entries_in_the_central_directory)>(records.size());
-    footer.size_of_the_central_directory
-        = static_cast<decltype(footer.size_of_the_central_directory)>(directory_size);
-    footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number
-        = static_cast<decltype(footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number)>(directory_offset);
-    tmp << footer;
+    tmp.close();
 
     if (!opts.quiet)
-        cout << "   footer written" << endl;
-
-    tmp.close();
+        out << "   footer written" << endl;
 
     const auto mtime = fs::last_write_time(path);
 
     fs::trash(path);
     if (!opts.quiet)
-        cout << "   trashed" << endl;
+        out << "   trashed" << endl;
 
     fs::rename(tmp_path, path);
     if (!opts.quiet)
-        cout << "   renamed" << endl;
+        out << "   renamed" << endl;
 
     fs::last_write_time(path, mtime);
 }
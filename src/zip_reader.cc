@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include <boost/interprocess/streams/bufferstream.hpp>
+
+#include "path_ops.h"
+#include "pkzip_io.h"
+#include "pkzip_layout.h"
+
+#include "zip_reader.h"
+
+using namespace zz;
+using namespace std;
+
+using boost::interprocess::ibufferstream;
+using boost::interprocess::read_only;
+using pkzip::detail::load_le;
+
+static inline auto make_stream(const uint8_t *data, uint64_t size)
+{
+    return ibufferstream(reinterpret_cast<const char *>(data), static_cast<size_t>(size));
+}
+
+namespace
+{
+    // where the end records put the central directory
+    struct directory_location
+    {
+        uint64_t number_of_entries;
+        uint64_t offset;
+        uint64_t size;
+    };
+}
+
+static directory_location locate_directory(const uint8_t *p, uint64_t n, const fs::path &filename)
+{
+    // the record is followed by a comment of up to 64 KiB, whose length must take it to the end of the file:
+    // a signature that does not is part of the comment
+    using footer_layout = pkzip::layout<pkzip::end_of_central_directory_record>;
+    constexpr uint64_t footer_size = footer_layout::size;
+    if (n < footer_size)
+        throw runtime_error("end of central directory not found: " + filename);
+    const auto lower = n - min(n, footer_size + numeric_limits<uint16_t>::max());
+    auto footer_offset = n - footer_size;
+    while (load_le<uint32_t>(p + footer_offset) != pkzip::end_of_central_directory_record_signature ||
+           load_le<uint16_t>(p + footer_offset + footer_layout::offset_of<&pkzip::end_of_central_directory_record::zip_file_comment_length>)
+               != n - footer_size - footer_offset) {
+        if (footer_offset == lower)
+            throw runtime_error("end of central directory not found: " + filename);
+        footer_offset--;
+    }
+    pkzip::end_of_central_directory_record footer;
+    make_stream(p + footer_offset, n - footer_offset) >> footer;
+
+    directory_location directory = {
+        footer.total_number_of_entries_in_the_central_directory,
+        footer.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number,
+        footer.size_of_the_central_directory,
+    };
+    constexpr uint64_t locator_size = pkzip::layout<pkzip::zip64_end_of_central_directory_locator>::size;
+    if (footer_offset >= locator_size &&
+        load_le<uint32_t>(p + footer_offset - locator_size) == pkzip::zip64_end_of_central_directory_locator_signature) {
+        pkzip::zip64_end_of_central_directory_locator locator;
+        make_stream(p + footer_offset - locator_size, locator_size) >> locator;
+        const auto record_offset = locator.relative_offset_of_the_zip64_end_of_central_directory_record;
+        pkzip::zip64_end_of_central_directory_record record;
+        if (record_offset < footer_offset)
+            make_stream(p + record_offset, footer_offset - record_offset) >> record;
+        if (!record)
+            throw runtime_error("invalid zip64 end of central directory: " + filename);
+        directory.number_of_entries = record.total_number_of_entries_in_the_central_directory;
+        directory.offset            = record.offset_of_start_of_central_directory_with_respect_to_the_starting_disk_number;
+        directory.size              = record.size_of_the_central_directory;
+    }
+    if (directory.offset > footer_offset || directory.size > footer_offset - directory.offset)
+        throw runtime_error("invalid central directory: " + filename);
+    return directory;
+}
+
+zip_reader::zip_reader(const fs::path &path, const string &charset)
+    : _path(path)
+    , _file(path.c_str(), read_only)
+    , _region(_file, read_only)
+{
+    const auto filename = path.filename();
+    const auto p = begin();
+    const auto location = locate_directory(p, size(), filename);
+
+    auto directory = make_stream(p + location.offset, location.size);
+    _records.reserve(static_cast<size_t>(min(location.number_of_entries,
+                                             location.size / pkzip::layout<pkzip::central_file_header>::size)));
+    for (uint64_t i = 0; i < location.number_of_entries; i++) {
+        pkzip::central_file_header record(charset);
+        if (!(directory >> record) || !record)
+            throw runtime_error("invalid central directory: " + filename);
+        _records.push_back(move(record));
+    }
+}
+
+bool zip_reader::has_deflated_entries(const fs::path &path)
+{
+    using layout_type = pkzip::layout<pkzip::central_file_header>;
+    const auto filename = path.filename();
+    const boost::interprocess::file_mapping file(path.c_str(), read_only);
+    const boost::interprocess::mapped_region region(file, read_only);
+    const auto p = static_cast<const uint8_t *>(region.get_address());
+    const auto location = locate_directory(p, region.get_size(), filename);
+
+    // only the fixed fields are read, to find the method and the start of the next record
+    auto offset = location.offset;
+    const auto end = location.offset + location.size;
+    for (uint64_t i = 0; i < location.number_of_entries; i++) {
+        if (end - offset < layout_type::size || load_le<uint32_t>(p + offset) != pkzip::central_file_header_signature)
+            throw runtime_error("invalid central directory: " + filename);
+        if (load_le<uint16_t>(p + offset + layout_type::offset_of<&pkzip::central_file_header::compression_method>) ==
+            pkzip::compression_method::deflated)
+            return true;
+        offset += layout_type::size
+                + load_le<uint16_t>(p + offset + layout_type::offset_of<&pkzip::central_file_header::file_name_length>)
+                + load_le<uint16_t>(p + offset + layout_type::offset_of<&pkzip::central_file_header::extra_field_length>)
+                + load_le<uint16_t>(p + offset + layout_type::offset_of<&pkzip::central_file_header::file_comment_length>);
+        if (offset > end)
+            throw runtime_error("invalid central directory: " + filename);
+    }
+    return false;
+}
+
+string_view zip_reader::data(const pkzip::central_file_header &record) const
+{
+    const auto data_offset = this->data_offset(record);
+    return string_view(reinterpret_cast<const char *>(begin() + data_offset), static_cast<size_t>(pkzip::get_compressed_size(record)));
+}
+
+uint64_t zip_reader::data_offset(const pkzip::central_file_header &record) const
+{
+    using layout_type = pkzip::layout<pkzip::local_file_header>;
+    const auto p = begin();
+    const auto n = size();
+    const auto offset = pkzip::get_relative_offset_of_local_header(record);
+    if (offset > n || n - offset < layout_type::size ||
+        load_le<uint32_t>(p + offset) != pkzip::local_file_header_signature)
+        throw runtime_error("invalid local file header: " + _path.filename());
+    const auto file_name_length   = load_le<uint16_t>(p + offset + layout_type::offset_of<&pkzip::local_file_header::file_name_length>);
+    const auto extra_field_length = load_le<uint16_t>(p + offset + layout_type::offset_of<&pkzip::local_file_header::extra_field_length>);
+    const auto data_offset = offset + layout_type::size + file_name_length + extra_field_length;
+    const auto data_size   = pkzip::get_compressed_size(record);
+    if (data_offset > n || data_size > n - data_offset)
+        throw runtime_error("truncated entry: " + _path.filename());
+    return data_offset;
+}
+
+void zip_reader::close() noexcept
+{
+    _region = boost::interprocess::mapped_region();
+    _file   = boost::interprocess::file_mapping();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "config.h"
+
+#include "pkzip.h"
+
+namespace zz
+{
+    /// Maps a zip archive and lists its entries from the central directory.
+    class zip_reader
+    {
+        zip_reader(const zip_reader &) = delete;
+        zip_reader & operator = (const zip_reader &) = delete;
+    public:
+        zip_reader(const fs::path &, const std::string &charset);
+
+        /// Whether any entry is deflated, as the central directory says; no entry is decoded, names included.
+        static bool has_deflated_entries(const fs::path &);
+
+        const std::vector<pkzip::central_file_header> & records() const noexcept
+        {
+            return _records;
+        }
+        /// Compressed payload of the entry, located through its local header on first use.
+        std::string_view data(const pkzip::central_file_header &) const;
+        /// Offset of that payload in the file.
+        uint64_t data_offset(const pkzip::central_file_header &) const;
+        /// The whole file.
+        std::string_view contents() const noexcept
+        {
+            return std::string_view(reinterpret_cast<const char *>(begin()), static_cast<size_t>(size()));
+        }
+
+        void close() noexcept;
+    private:
+        const uint8_t * begin() const noexcept
+        {
+            return static_cast<const uint8_t *>(_region.get_address());
+        }
+        uint64_t size() const noexcept
+        {
+            return _region.get_size();
+        }
+
+        fs::path                                 _path;
+        boost::interprocess::file_mapping        _file;
+        boost::interprocess::mapped_region       _region;
+        std::vector<pkzip::central_file_header>  _records;
+    };
+}
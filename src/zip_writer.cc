@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "path_ops.h"
+#include "pkzip_io.h"
+#include "pkzip_layout.h"
+
+#include "zip_writer.h"
+
+using namespace zz;
+using namespace std;
+
+zip_writer::zip_writer(const fs::path &path)
+    : _file(path)
+    , _buffer(buffer_size)
+    , _header(string())
+{
+}
+
+void zip_writer::open_entry(pkzip::local_file_header header, uint64_t compressed_size, uint64_t uncompressed_size,
+                            uint32_t external_file_attributes)
+{
+    if (_open)
+        throw logic_error("entry already open");
+
+    // a stored entry gets no descriptor, so that it can be read from its local header alone: that header is held
+    // back like a reserved one instead, and goes out with the CRC on close
+    _held_back = false;
+    if (header.general_purpose_bit_flag & pkzip::general_purpose_bit_flags::has_data_descriptor) {
+        if (header.compression_method == pkzip::compression_method::stored) {
+            header.general_purpose_bit_flag &= ~pkzip::general_purpose_bit_flags::has_data_descriptor;
+            _held_back = true;
+        } else {
+            header.crc32 = 0;
+        }
+    }
+    // the sizes stay in the local header even with a descriptor
+    pkzip::set_sizes(header, compressed_size, uncompressed_size);
+
+    _header_offset = _offset;
+    if (_held_back) {
+        flush();
+        _scratch.str({});
+        _scratch << header;
+        _headers.emplace_back(_header_offset, _scratch.str());
+        _offset += _headers.back().second.size();
+    } else {
+        put(header);
+    }
+
+    _header     = move(header);
+    _expected     = compressed_size;
+    _uncompressed = uncompressed_size;
+    _written      = 0;
+    _attributes   = external_file_attributes;
+    _crc32        = crc32_t();
+    _crc_given    = false;
+    _open         = true;
+}
+
+void zip_writer::write(const void *data, size_t size)
+{
+    if (_held_back)
+        _crc32.process_bytes(data, size);
+    put(data, size);
+    _written += size;
+}
+
+copy_method zip_writer::copy(const file &source, uint64_t offset, uint64_t size, uint32_t crc32)
+{
+    if (_written)
+        throw logic_error("entry already partly written");
+
+    flush();
+    auto method = _file.copy_range(source, offset, size, _offset);
+    if (method == copy_method::none) {
+        for (uint64_t copied = 0; copied < size; ) {
+            const auto n = source.read_at(_buffer.data(), static_cast<size_t>(min<uint64_t>(size - copied, _buffer.size())),
+                                          offset + copied);
+            if (n == 0)
+                throw runtime_error("truncated entry: " + fs::path(_header.file_name));
+            _file.write_at(_buffer.data(), n, _offset + copied);
+            copied += n;
+        }
+    }
+    _offset  += size;
+    _written += size;
+    _header.crc32 = crc32;
+    _crc_given    = true;
+    return method;
+}
+
+void zip_writer::close_entry()
+{
+    if (!_open)
+        throw logic_error("no entry open");
+    _open = false;
+    if (_written != _expected)
+        throw runtime_error("size changed while writing: " + fs::path(_header.file_name));
+
+    if (_header.general_purpose_bit_flag & pkzip::general_purpose_bit_flags::has_data_descriptor) {
+        // the data written is compressed, so its CRC says nothing of the entry
+        if (!_crc_given)
+            throw logic_error("no CRC given for a compressed entry");
+        using pkzip::detail::store_le;
+        uint8_t descriptor[24];
+        const auto zip64 = _header.uncompressed_size == numeric_limits<uint32_t>::max();
+        store_le(descriptor, pkzip::data_descriptor_signature);
+        store_le(descriptor + 4, _header.crc32);
+        if (zip64) {
+            store_le(descriptor +  8, _written);
+            store_le(descriptor + 16, _uncompressed);
+        } else {
+            store_le(descriptor +  8, static_cast<uint32_t>(_written));
+            store_le(descriptor + 12, static_cast<uint32_t>(_uncompressed));
+        }
+        put(descriptor, zip64 ? 24 : 16);
+    } else if (_held_back) {
+        if (!_crc_given)
+            _header.crc32 = _crc32();
+        // the CRC sits at the same place in every local header
+        pkzip::detail::store_le(reinterpret_cast<uint8_t *>(_headers.back().second.data()) + 14, _header.crc32);
+    }
+
+    _records.push_back(pkzip::make_central_file_header(_header, _written, _uncompressed, _header_offset, _attributes));
+}
+
+uint64_t zip_writer::reserve_entry(pkzip::local_file_header header, uint64_t compressed_size, uint64_t uncompressed_size,
+                                   uint32_t external_file_attributes)
+{
+    if (_open)
+        throw logic_error("entry already open");
+    if (header.general_purpose_bit_flag & pkzip::general_purpose_bit_flags::has_data_descriptor)
+        throw logic_error("reserved entries cannot have a data descriptor");
+
+    pkzip::set_sizes(header, compressed_size, uncompressed_size);
+    const auto header_offset = _offset;
+    _records.push_back(pkzip::make_central_file_header(header, compressed_size, uncompressed_size, header_offset,
+                                                       external_file_attributes));
+
+    // the header itself is written later, so that the whole layout can be allocated first
+    flush();
+    _scratch.str({});
+    _scratch << header;
+    _headers.emplace_back(header_offset, _scratch.str());
+    _offset += _headers.back().second.size() + compressed_size;
+    return _offset - compressed_size;
+}
+
+void zip_writer::set_crc32(size_t n, uint32_t crc32)
+{
+    auto &record = _records.at(n);
+    const auto header_offset = pkzip::get_relative_offset_of_local_header(record);
+    const auto it = lower_bound(begin(_headers), end(_headers), header_offset,
+                                [](const auto &header, uint64_t offset) { return header.first < offset; });
+    if (it == end(_headers) || it->first != header_offset)
+        throw logic_error("entry not reserved");
+
+    record.crc32 = crc32;
+    // the CRC sits at the same place in every local header
+    pkzip::detail::store_le(reinterpret_cast<uint8_t *>(it->second.data()) + 14, crc32);
+}
+
+void zip_writer::preallocate()
+{
+    uint64_t directory_size = 0;
+    for (const auto &record : _records) {
+        _scratch.str({});
+        _scratch << record;
+        directory_size += _scratch.view().size();
+    }
+    _scratch.str({});
+    pkzip::write_end_of_central_directory(_scratch, _records.size(), _offset, directory_size);
+    _allocated = _file.allocate(_offset + directory_size + _scratch.view().size());
+}
+
+void zip_writer::close()
+{
+    if (_open)
+        throw logic_error("entry still open");
+
+    for (const auto &[offset, header] : _headers)
+        _file.write_at(header.data(), header.size(), offset);
+    _headers.clear();
+
+    const auto directory_offset = _offset;
+    for (const auto &record : _records)
+        put(record);
+    const auto directory_size = _offset - directory_offset;
+    _scratch.str({});
+    pkzip::write_end_of_central_directory(_scratch, _records.size(), directory_offset, directory_size);
+    const auto footer = _scratch.view();
+    put(footer.data(), footer.size());
+
+    flush();
+    // entries discarded after the allocation leave it longer than needed
+    if (_allocated)
+        _file.resize(_offset);
+    _file.close();
+}
+
+void zip_writer::put(const void *data, size_t size)
+{
+    if (_used + size > _buffer.size()) {
+        flush();
+        if (size >= _buffer.size()) {
+            _file.write_at(data, size, _offset);
+            _offset += size;
+            return;
+        }
+    }
+    memcpy(_buffer.data() + _used, data, size);
+    _used   += size;
+    _offset += size;
+}
+
+template <typename record_type>
+void zip_writer::put(const record_type &record)
+{
+    _scratch.str({});
+    _scratch << record;
+    const auto s = _scratch.view();
+    put(s.data(), s.size());
+}
+
+void zip_writer::flush()
+{
+    if (_used)
+        _file.write_at(_buffer.data(), _used, _offset - _used);
+    _used = 0;
+}
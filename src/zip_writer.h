@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+
+#include "crc32.h"
+#include "file.h"
+#include "pkzip.h"
+
+namespace zz
+{
+    /// Writes a zip archive front to back, without ever seeking back to patch a header.
+    class zip_writer
+    {
+        zip_writer(const zip_writer &) = delete;
+        zip_writer & operator = (const zip_writer &) = delete;
+    public:
+        static constexpr size_t buffer_size = 1 << 20;
+
+        explicit zip_writer(const fs::path &);
+
+        /// Starts an entry whose data is written as is, in the header's compression method.
+        /// Unless the header asks for a data descriptor, its CRC must already be filled in. Otherwise a compressed
+        /// entry is given its CRC on close and gets a descriptor, while a stored one, which never does, has its CRC
+        /// computed while writing and put in its local header, written on close.
+        void open_entry(pkzip::local_file_header header, uint64_t compressed_size, uint64_t uncompressed_size,
+                        uint32_t external_file_attributes);
+        void open_entry(pkzip::local_file_header header, uint64_t size, uint32_t external_file_attributes = 0)
+        {
+            open_entry(std::move(header), size, size, external_file_attributes);
+        }
+        void write(const void *data, size_t size);
+        /// Fills the open entry with data taken from another file, inside the kernel when possible.
+        /// The data is not read back to compute the CRC; the given one is used where a computed one would be.
+        copy_method copy(const file &source, uint64_t offset, uint64_t size, uint32_t crc32);
+        void close_entry();
+        /// Ends an entry whose CRC was not known when it was opened, such as a compressed one with a data descriptor.
+        void close_entry(uint32_t crc32)
+        {
+            _header.crc32 = crc32;
+            _crc_given    = true;
+            close_entry();
+        }
+
+        /// Lays out an entry whose data is filled in later with write_at; its header goes out on close.
+        /// The header must carry its CRC. Returns the offset of the data.
+        uint64_t reserve_entry(pkzip::local_file_header header, uint64_t compressed_size, uint64_t uncompressed_size,
+                               uint32_t external_file_attributes);
+        /// Allocates the disk space of the whole archive at once, once every entry has been laid out.
+        void preallocate();
+        /// Fills in reserved data; may be called from several threads at once.
+        void write_at(const void *data, size_t size, uint64_t offset)
+        {
+            _file.write_at(data, size, offset);
+        }
+        /// Fills in reserved data from another file, inside the kernel when possible.
+        copy_method copy_range(const file &source, uint64_t source_offset, uint64_t size, uint64_t offset)
+        {
+            return _file.copy_range(source, source_offset, size, offset);
+        }
+
+        /// Sets the CRC of the n-th entry, reserved before its data was known; its header must not be written yet.
+        void set_crc32(size_t n, uint32_t crc32);
+
+        /// Leaves the n-th entry out of the central directory.
+        void discard_entry(size_t n)
+        {
+            _records.erase(_records.begin() + static_cast<ptrdiff_t>(n));
+        }
+
+        size_t entries() const noexcept
+        {
+            return _records.size();
+        }
+
+        /// Writes the central directory and the end records, then closes the file.
+        void close();
+    private:
+        void put(const void *data, size_t size);
+        template <typename record_type>
+        void put(const record_type &);
+        void flush();
+
+        file                                          _file;
+        std::vector<char>                             _buffer;
+        size_t                                        _used   = 0;
+        uint64_t                                      _offset = 0;
+        std::ostringstream                            _scratch;
+        std::vector<pkzip::central_file_header>       _records;
+        std::vector<std::pair<uint64_t, std::string>> _headers;
+        bool                                          _allocated = false;
+
+        pkzip::local_file_header                      _header;
+        uint64_t                                      _header_offset = 0;
+        uint64_t                                      _expected      = 0;
+        uint64_t                                      _uncompressed  = 0;
+        uint64_t                                      _written       = 0;
+        uint32_t                                      _attributes    = 0;
+        crc32_t                                       _crc32;
+        bool                                          _crc_given     = false;   // given rather than computed
+        bool                                          _held_back     = false;   // the local header waits for the CRC
+        bool                                          _open          = false;
+    };
+}
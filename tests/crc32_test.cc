@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <boost/crc.hpp>
+
+#include "crc32.h"
+
+using namespace zz;
+using namespace std;
+
+// Compares every CRC-32 kernel the machine has, and update_crc32, with Boost on random data:
+// lengths around the fold widths, start pointers off any alignment, and computations split into chained calls.
+
+static uint32_t reference(const uint8_t *p, size_t n)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(p, n);
+    return crc.checksum();
+}
+
+int main()
+{
+    mt19937_64 random(20260501);
+    vector<uint8_t> data(1 << 20);
+    for (auto &byte : data)
+        byte = static_cast<uint8_t>(random());
+
+    vector<size_t> lengths = { 0, 1, 2, 3, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129,
+                               255, 256, 257, 511, 512, 513, 1023, 1024, 4095, 4096, 4097, 65535, 65536, 65537 };
+    for (size_t i = 0; i < 200; i++)
+        lengths.push_back(random() % 20000);
+    lengths.push_back(data.size() - 64);
+
+    auto kernels = detail::crc32_kernels();
+    // the dispatching entry point, kept plain
+    kernels.emplace_back("update_crc32", [](uint32_t crc, const uint8_t *p, size_t n) noexcept {
+        return ~update_crc32(~crc, p, n);
+    });
+
+    size_t failures = 0;
+    const auto check = [&failures](const char *name, size_t offset, size_t length, uint32_t actual, uint32_t expected) {
+        if (actual == expected)
+            return;
+        if (++failures <= 20)
+            cerr << name << ": offset " << offset << ", length " << length << ": " << hex << actual
+                 << " instead of " << expected << dec << endl;
+    };
+    for (const auto &[name, kernel] : kernels) {
+        for (const auto length : lengths) {
+            for (size_t offset = 0; offset < 64; offset += offset < 16 ? 1 : 7) {
+                const auto p = data.data() + offset;
+                const auto expected = reference(p, length);
+                check(name, offset, length, ~kernel(~0u, p, length), expected);
+
+                // the same data in up to four calls, cut anywhere
+                vector<size_t> cuts = { 0, length };
+                for (size_t i = 0; i < 3; i++)
+                    cuts.push_back(length ? random() % (length + 1) : 0);
+                sort(cuts.begin(), cuts.end());
+                uint32_t crc = ~0u;
+                for (size_t i = 1; i < cuts.size(); i++)
+                    crc = kernel(crc, p + cuts[i - 1], cuts[i] - cuts[i - 1]);
+                check(name, offset, length, ~crc, expected);
+            }
+        }
+        cout << name << ": checked" << endl;
+    }
+    if (failures) {
+        cerr << failures << " mismatches" << endl;
+        return 1;
+    }
+    return 0;
+}
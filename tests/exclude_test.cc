@@ -0,0 +1,69 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "exclude.h"
+
+using namespace zz;
+using namespace std;
+
+// Matches paths against --exclude patterns of each kind, above all "**" in every position.
+
+int main()
+{
+    using string_type = exclude_matcher::string_type;
+
+    struct
+    {
+        const char *pattern;
+        const char *path;
+        bool        excluded;
+    } const cases[] = {
+        { "a/b.txt",      "a/b.txt",         true  },
+        { "a/b.txt",      "x/a/b.txt",       false },
+        { "*.txt",        "a/b.txt",         true  },
+        { "*.txt",        "a/b.txt2",        false },
+        { "a/*.txt",      "a/b.txt",         true  },
+        { "a/*.txt",      "a/c/b.txt",       false },
+        { "a/?.txt",      "a/b.txt",         true  },
+        { "a/[b-d].txt",  "a/c.txt",         true  },
+        { "a/[!b-d].txt", "a/c.txt",         false },
+        { "**/b",         "b",               true  },
+        { "**/b",         "a/c/b",           true  },
+        { "**/b",         "a/cb",            false },
+        { "a/**/b",       "a/b",             true  },
+        { "a/**/b",       "a/c/b",           true  },
+        { "a/**/b",       "a/c/d/b",         true  },
+        { "a/**/b",       "a/cb",            false },
+        { "a/**/b",       "ab",              false },
+        { "a/**/**/b",    "a/b",             true  },
+        { "a/**/c/**/b",  "a/c/b",           true  },
+        { "a/**/c/**/b",  "a/x/c/y/b",       true  },
+        { "a/**b",        "a/b",             true  },
+        { "a/**b",        "a/x/yb",          true  },
+        { "a**/b",        "a/b",             true  },
+        { "a**/b",        "b",               false },
+        { "a/**",         "a/b/c",           true  },
+        { "a/**",         "ab",              false },
+    };
+
+    auto failures = 0;
+    for (const auto &c : cases) {
+        const exclude_matcher excludes({ string_type(c.pattern, c.pattern + char_traits<char>::length(c.pattern)) });
+        const string path(c.path);
+        if (excludes(string_type(begin(path), end(path))) != c.excluded) {
+            cerr << c.pattern << ": " << c.path << (c.excluded ? " not excluded" : " excluded") << endl;
+            failures++;
+        }
+    }
+
+    const exclude_matcher trees({ string_type{ 'a', '/', '*', '*', '/', 'b', '/', '*', '*' } });
+    for (const auto &[directory, excluded] : { pair{ "a/b", true }, { "a/c/b", true }, { "a/c", false } }) {
+        const string path(directory);
+        if (trees.excludes_tree(string_type(begin(path), end(path))) != excluded) {
+            cerr << "a/**/b/**: tree " << directory << (excluded ? " not excluded" : " excluded") << endl;
+            failures++;
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "charset.h"
+#include "crc32.h"
+#include "rar_reader.h"
+
+using namespace zz;
+using namespace std;
+
+// Reads small stored archives built here, version 4 and 5, and checks what the headers say: names in every encoding
+// the reader decodes, sizes, CRCs or their absence, times, kinds of entries and where the data is. Then damages them:
+// a header whose CRC does not match, and archives cut short in a header or in data.
+
+using bytes = string;
+
+static size_t failures = 0;
+
+static void check(bool condition, const string &what)
+{
+    if (!condition && ++failures <= 20)
+        cerr << what << endl;
+}
+
+static bytes le(uint64_t value, size_t size)
+{
+    bytes s;
+    for (size_t i = 0; i < size; i++)
+        s += static_cast<char>(value >> (8 * i) & 0xFF);
+    return s;
+}
+
+static bytes vint(uint64_t value)
+{
+    bytes s;
+    for (; value >= 0x80; value >>= 7)
+        s += static_cast<char>((value & 0x7F) | 0x80);
+    return s + static_cast<char>(value);
+}
+
+static uint32_t crc_of(const bytes &s)
+{
+    return update_crc32(0, s.data(), s.size());
+}
+
+static bytes contents(unsigned seed, size_t size)
+{
+    bytes s(size, '\0');
+    for (size_t i = 0; i < size; i++)
+        s[i] = static_cast<char>(seed * 131 + i * 7 + (i >> 9) * 13);
+    return s;
+}
+
+// a version 5 header: the CRC of the rest, its size, then the body from the type on
+static bytes rar5_header(const bytes &body)
+{
+    const auto h = vint(body.size()) + body;
+    return le(crc_of(h), 4) + h;
+}
+
+struct rar5_file
+{
+    string   name;
+    bytes    data;
+    bool     directory  = false;
+    bool     compressed = false;
+    bool     blake2     = false;
+    bool     unix_time  = false;    // in the base header rather than in a time record
+};
+
+static constexpr uint32_t mtime = 1614834368;     // 2021-03-04 05:06:08 UTC
+
+static bytes rar5(const vector<rar5_file> &files)
+{
+    bytes s = "Rar!\x1A\x07\x01\x00"s;
+    s += rar5_header(vint(1) + vint(0) + vint(0));
+    // a comment, which is not an entry
+    s += rar5_header(vint(3) + vint(2) + vint(5) + vint(0) + vint(0) + vint(0) + vint(0) + vint(0) + vint(0) + vint(3) + "CMT")
+       + "hello";
+    for (const auto &f : files) {
+        bytes extra;
+        uint64_t file_flags = f.directory ? 1 : 0;
+        if (f.unix_time) {
+            file_flags |= 2;
+        } else {
+            const auto record = vint(3) + vint(2) + le((mtime + 11'644'473'600ull) * 10'000'000, 8);
+            extra += vint(record.size()) + record;
+        }
+        if (f.blake2) {
+            const auto record = vint(2) + vint(0) + bytes(32, '\0');
+            extra += vint(record.size()) + record;
+        } else {
+            file_flags |= 4;
+        }
+        const auto packed = f.compressed ? bytes(f.data.rbegin(), f.data.rend()) : f.data;
+        auto fields = vint(file_flags) + vint(f.data.size()) + vint(0x20);
+        if (file_flags & 2)
+            fields += le(mtime, 4);
+        if (file_flags & 4)
+            fields += le(crc_of(f.data), 4);
+        fields += vint((f.compressed ? 3 : 0) << 7) + vint(1) + vint(f.name.size()) + f.name;
+        s += rar5_header(vint(2) + vint(2 | (extra.empty() ? 0 : 1)) + (extra.empty() ? bytes() : vint(extra.size()))
+                         + vint(packed.size()) + fields + extra) + packed;
+    }
+    return s + rar5_header(vint(5) + vint(4) + vint(0));
+}
+
+// a version 4 block: the low half of the CRC of the rest, then type, flags and size
+static bytes rar4_block(uint8_t type, uint16_t flags, const bytes &rest)
+{
+    const auto b = le(type, 1) + le(flags, 2) + le(7 + rest.size(), 2) + rest;
+    return le(crc_of(b) & 0xFFFF, 2) + b;
+}
+
+static constexpr uint32_t dos_time = (41u << 25) | (3u << 21) | (4u << 16) | (5u << 11) | (6u << 5) | 4u;
+
+// the fields of a file block, which a service block shares
+static bytes rar4_file_fields(const bytes &name, const bytes &data)
+{
+    return le(data.size(), 4) + le(data.size(), 4) + le(2, 1) + le(crc_of(data), 4) + le(dos_time, 4)
+         + le(29, 1) + le(0x30, 1) + le(name.size(), 2) + le(0x20, 4) + name;
+}
+
+static bytes rar4(const vector<pair<bytes, bytes>> &files, bool unicode_last)
+{
+    bytes s = "Rar!\x1A\x07\x00"s;
+    s += rar4_block(0x73, 0, bytes(6, '\0'));
+    // a comment, which is not an entry
+    s += rar4_block(0x7A, 0x8000, rar4_file_fields("CMT", "hello")) + "hello";
+    for (size_t i = 0; i < files.size(); i++) {
+        const auto &[name, data] = files[i];
+        uint16_t flags = 0x8000;
+        if (unicode_last && i + 1 == files.size())
+            flags |= 0x0200;
+        s += rar4_block(0x74, flags, rar4_file_fields(name, data)) + data;
+    }
+    return s + rar4_block(0x7B, 0x4000, bytes());
+}
+
+static const fs::path archive_path = fs::path("rar_reader_test.rar");
+
+static void write(const bytes &s)
+{
+    ofstream os(archive_path, ios::binary | ios::trunc);
+    os.write(s.data(), static_cast<streamsize>(s.size()));
+}
+
+static void expect_error(const bytes &s, const string &message, const string &what)
+{
+    write(s);
+    try {
+        const rar_reader reader(archive_path, "cp932");
+        check(false, what + ": no error");
+    } catch (const runtime_error &ex) {
+        check(string(ex.what()).starts_with(message), what + ": " + ex.what());
+    }
+}
+
+static fs::path::string_type native(const string &utf8)
+{
+    return charset::decode_utf8(utf8);
+}
+
+int main()
+{
+    const auto file10 = contents(1, 5000), big = contents(2, 300000), blake2 = contents(6, 9000), packed = contents(7, 10);
+
+    // version 5
+    const auto archive5 = rar5({
+        { "b/file10", file10 },
+        { "x/y/\xE6\x97\xA5\xE6\x9C\xAC", big, false, false, false, true },
+        { "d", {}, true },
+        { "h", blake2, false, false, true },
+        { "q", packed, false, true },
+    });
+    write(archive5);
+    {
+        const rar_reader reader(archive_path, "cp932");
+        const auto &r = reader.records();
+        check(r.size() == 5, "rar5: " + to_string(r.size()) + " records");
+        if (r.size() == 5) {
+            check(r[0].name == native("b/file10") && r[0].size == size(file10) && r[0].has_crc32 &&
+                  r[0].crc32 == crc_of(file10) && r[0].copyable() && reader.data(r[0]) == file10, "rar5: b/file10");
+            check(r[1].name == native("x/y/\xE6\x97\xA5\xE6\x9C\xAC") && reader.data(r[1]) == big && r[1].copyable(),
+                  "rar5: utf-8 name");
+            check(r[0].dos_date_time != 0 && r[0].dos_date_time == r[1].dos_date_time,
+                  "rar5: the time record and the base header disagree");
+            check(r[2].directory && !r[2].copyable(), "rar5: directory");
+            check(!r[3].has_crc32 && r[3].copyable() && reader.data(r[3]) == blake2, "rar5: BLAKE2 entry");
+            check(!r[4].stored && !r[4].copyable() && r[4].packed_size == size(packed), "rar5: compressed entry");
+        }
+        check(!reader.volume() && !reader.solid(), "rar5: archive flags");
+    }
+
+    // a byte of the name changed, so that the header CRC no longer matches
+    auto damaged = archive5;
+    damaged[archive5.find("b/file10")] = 'c';
+    expect_error(damaged, "invalid header", "rar5: header CRC");
+    // cut in the data of the second file, then in its header
+    const auto second = archive5.find("x/y/");
+    expect_error(archive5.substr(0, second + 100), "truncated archive", "rar5: truncated data");
+    expect_error(archive5.substr(0, second - 3), "invalid header", "rar5: truncated header");
+
+    // version 4: a name in the given charset, an ASCII one, and a unicode one stored in every form the encoding has
+    const auto japanese = charset::encode(native("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E\\\xE3\x83\x95\xE3\x82\xA1"
+                                                 "\xE3\x82\xA4\xE3\x83\xAB"), "cp932");
+    // "abc" copied from the other name, U+2013 and U+2014 from its next two bytes with a correction, U+00FC as a
+    // byte alone, U+20AC as a byte under the common high byte, and U+1F600 as two whole units
+    const auto unicode_name = "abc?@"s + '\0' + "\x20"s
+                            + "\xF1"s + "\x01"s + "\x80\xD4"s + "\xFC"s + "\xAC"s
+                            + "\xA0"s + "\x3D\xD8"s + "\x00\xDE"s;
+    const auto archive4 = rar4({ { japanese, big }, { "b\\file10", file10 }, { unicode_name, blake2 } }, true);
+    write(archive4);
+    {
+        const rar_reader reader(archive_path, "cp932");
+        const auto &r = reader.records();
+        check(r.size() == 3, "rar4: " + to_string(r.size()) + " records");
+        if (r.size() == 3) {
+            check(r[0].name == native("\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E\\\xE3\x83\x95\xE3\x82\xA1\xE3\x82\xA4\xE3\x83\xAB") &&
+                  reader.data(r[0]) == big, "rar4: cp932 name");
+            check(r[1].name == native("b\\file10") && r[1].crc32 == crc_of(file10) && r[1].dos_date_time == dos_time &&
+                  r[1].copyable() && reader.data(r[1]) == file10, "rar4: b\\file10");
+            check(r[2].name == native("abc\xE2\x80\x93\xE2\x80\x94\xC3\xBC\xE2\x82\xAC\xF0\x9F\x98\x80"), "rar4: unicode name");
+        }
+    }
+
+    damaged = archive4;
+    damaged[archive4.find("b\\file10")] = 'c';
+    expect_error(damaged, "invalid header", "rar4: header CRC");
+    const auto last = archive4.find("b\\file10");
+    expect_error(archive4.substr(0, last + 100), "truncated archive", "rar4: truncated data");
+    expect_error(archive4.substr(0, last - 3), "invalid header", "rar4: truncated header");
+
+    fs::remove(archive_path);
+    if (failures) {
+        cerr << failures << " failures" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <climits>
+#include <cwchar>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "natural_sort.h"
+#include "strnatcmp.h"
+
+using namespace zz;
+using namespace std;
+
+// Checks that the keys of strnatcasekey order random strings exactly as strnatcasecmp does, for narrow and
+// wide strings: runs of digits with and without leading zeros, spaces inside, after numbers and at the end,
+// both cases, and the lowest units of each type, which the keys escape. Then checks natural_sort against the
+// same comparison.
+
+static int sign(int n)
+{
+    return (n > 0) - (n < 0);
+}
+
+template <typename char_type>
+static size_t check(mt19937_64 &random, const vector<char_type> &alphabet)
+{
+    using string_type = basic_string<char_type>;
+
+    const auto make = [&] {
+        string_type s;
+        for (auto n = random() % 12; n > 0; n--) {
+            // runs of digits are common, so that numbers of several lengths meet
+            if (random() % 3 == 0)
+                for (auto m = random() % 4 + 1; m > 0; m--)
+                    s += static_cast<char_type>('0' + random() % 3 * 4 % 10);
+            else
+                s += alphabet[random() % alphabet.size()];
+        }
+        return s;
+    };
+    // a string and a close variant of it, to compare more than their first unit
+    const auto vary = [&](string_type s) {
+        for (auto n = random() % 3 + 1; n > 0; n--) {
+            const auto pos = s.empty() ? 0 : random() % (s.size() + 1);
+            switch (random() % 3) {
+            case 0:
+                s.insert(s.begin() + static_cast<ptrdiff_t>(pos), alphabet[random() % alphabet.size()]);
+                break;
+            case 1:
+                if (pos < s.size())
+                    s.erase(pos, 1);
+                break;
+            default:
+                s.insert(pos, string_type(random() % 3 + 1, static_cast<char_type>(random() % 2 ? '0' : ' ')));
+                break;
+            }
+        }
+        return s;
+    };
+
+    size_t failures = 0;
+    vector<string_type> names;
+    for (size_t i = 0; i < 50000; i++) {
+        const auto a = make();
+        const auto b = random() % 2 ? vary(a) : make();
+        const auto expected = sign(strnatcasecmp(a, b));
+        const auto actual   = sign(strnatcasekey(a).compare(strnatcasekey(b)));
+        if (actual != expected && ++failures <= 20)
+            cerr << "key order " << actual << " instead of " << expected << " for \""
+                 << string(a.begin(), a.end()) << "\" and \"" << string(b.begin(), b.end()) << "\"" << endl;
+        if (names.size() < 20000)
+            names.push_back(a);
+    }
+
+    // in one share, then in several, an odd number of them included, which are merged in pairs;
+    // the names carry their index, so that equal names can be seen to keep their order
+    vector<pair<string_type, size_t>> indexed;
+    for (size_t i = 0; i < names.size(); i++)
+        indexed.emplace_back(names[i], i);
+    for (const auto &[jobs, min_share] : { pair<size_t, size_t>(1, 1 << 14), { 2, 4000 }, { 3, 4000 }, { 5, 4000 } }) {
+        auto sorted = indexed;
+        natural_sort(sorted, [](const pair<string_type, size_t> &item) -> const auto & { return item.first; }, jobs, min_share);
+        vector<bool> seen(indexed.size());
+        for (const auto &[name, index] : sorted)
+            if (index < seen.size() && name == names[index])
+                seen[index] = true;
+        if (sorted.size() != indexed.size() || find(seen.begin(), seen.end(), false) != seen.end())
+            failures++, cerr << "natural_sort lost items with " << jobs << " jobs" << endl;
+        for (size_t i = 1; i < sorted.size(); i++) {
+            const auto order = strnatcasecmp(sorted[i - 1].first, sorted[i].first);
+            if ((order > 0 || (order == 0 && sorted[i - 1].second > sorted[i].second)) && ++failures <= 20)
+                cerr << "natural_sort out of order at " << i << " with " << jobs << " jobs" << endl;
+        }
+    }
+    return failures;
+}
+
+int main()
+{
+    mt19937_64 random(20260515);
+    size_t failures = 0;
+
+    failures += check<char>(random, { '0', '1', '9', ' ', ' ', 'a', 'A', 'b', 'B', 'z', '.', '/', '\0', '\1', '\x7F', '\xE3',
+                                      CHAR_MIN, CHAR_MIN + 1 });
+    cout << "char: checked" << endl;
+
+    failures += check<wchar_t>(random, { L'0', L'1', L'9', L' ', L' ', L'a', L'A', L'b', L'B', L'z', L'.', L'/', L'\0', L'\1',
+                                         L'\x100', L'\x3042', L'\xFF10',
+                                         WCHAR_MIN, WCHAR_MIN + 1, WCHAR_MIN + 0x1000000 });
+    cout << "wchar_t: checked" << endl;
+
+    if (failures) {
+        cerr << failures << " failures" << endl;
+        return 1;
+    }
+    return 0;
+}